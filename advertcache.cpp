@@ -0,0 +1,47 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "advertcache.h"
+
+AdvertCache::AdvertCache(int heartbeatSecs)
+    : m_heartbeatMs(qint64(heartbeatSecs) * 1000)
+{
+    m_clock.start();
+}
+
+/*!
+    Returns true if \a payload differs from the last one seen from
+    \a address with \a manufacturerId, or if the heartbeat interval has
+    passed since the last time it was let through.
+*/
+bool AdvertCache::isNew(const QBluetoothAddress &address, quint16 manufacturerId, const QByteArray &payload)
+{
+    const qint64 now = m_clock.elapsed();
+    const uint hash = qHash(payload);
+    auto it = m_entries.find(key(address, manufacturerId));
+    if (it == m_entries.end()) {
+        m_entries.insert(key(address, manufacturerId), Entry { hash, now });
+    } else if (it->hash != hash || now - it->timestamp >= m_heartbeatMs) {
+        it->hash = hash;
+        it->timestamp = now;
+    } else {
+        ++m_dropped;
+        return false;
+    }
+    ++m_passed;
+    return true;
+}
@@ -0,0 +1,61 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef ADVERTCACHE_H
+#define ADVERTCACHE_H
+
+#include <QBluetoothAddress>
+#include <QElapsedTimer>
+#include <QHash>
+
+/*
+    Remembers a hash of the last manufacturer data seen from each device,
+    so that adverts repeating the same payload can be dropped before they
+    are decoded.  An unchanged payload is let through again once the
+    heartbeat interval has passed, so that a steady reading still gets
+    recorded now and then.
+*/
+class AdvertCache
+{
+public:
+    explicit AdvertCache(int heartbeatSecs = 300);
+
+    void setHeartbeat(int secs) { m_heartbeatMs = qint64(secs) * 1000; }
+    bool isNew(const QBluetoothAddress &address, quint16 manufacturerId, const QByteArray &payload);
+
+    quint64 passedCount() const { return m_passed; }
+    quint64 droppedCount() const { return m_dropped; }
+
+private:
+    struct Entry {
+        uint hash;
+        qint64 timestamp; // ms on m_clock
+    };
+
+    static quint64 key(const QBluetoothAddress &address, quint16 manufacturerId)
+    {
+        return (address.toUInt64() << 16) | manufacturerId;
+    }
+
+    QHash<quint64, Entry> m_entries;
+    QElapsedTimer m_clock;
+    qint64 m_heartbeatMs;
+    quint64 m_passed = 0;
+    quint64 m_dropped = 0;
+};
+
+#endif // ADVERTCACHE_H
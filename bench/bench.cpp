@@ -0,0 +1,337 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <atomic>
+#include "devicedriver.h"
+#include "framedecoder.h"
+#include "lineprotocol.h"
+#include "profilestore.h"
+#include "userindex.h"
+
+/*
+    Counts every allocation, Qt's included: QString and QByteArray
+    allocate with malloc(), not operator new, so that's the one to count.
+    With glibc, a malloc() defined in the executable takes the place of
+    the real one for the Qt libraries too.
+*/
+static std::atomic<quint64> allocations(0);
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+}
+#define COUNTING_ALLOCATIONS
+#endif
+
+static const int minimumMs = 200;
+static const int allocationIterations = 10000;
+
+// keeps the compiler from optimizing away work whose result isn't used
+static volatile quint64 sink;
+
+/*
+    Runs \a op repeatedly and reports, depending on the current row,
+    either nanoseconds or allocations per call.  Both come out as ordinary
+    QTest benchmark results (WalltimeNanoseconds and Events), so -csv
+    gives something a script can compare against bench/baseline.csv.
+*/
+template <typename Op>
+static void measure(Op op)
+{
+    QFETCH(bool, countAllocations);
+    for (int i = 0; i < 1000; ++i) // warm up: caches, and buffers that are reserved once
+        op();
+
+    if (countAllocations) {
+#ifdef COUNTING_ALLOCATIONS
+        const quint64 before = allocations.load();
+        for (int i = 0; i < allocationIterations; ++i)
+            op();
+        QTest::setBenchmarkResult(qreal(allocations.load() - before) / allocationIterations, QTest::Events);
+#else
+        QSKIP("allocations are only counted with glibc");
+#endif
+        return;
+    }
+
+    qint64 calls = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (qint64 batch = 1000; timer.elapsed() < minimumMs; batch *= 2) {
+        for (qint64 i = 0; i < batch; ++i)
+            op();
+        calls += batch;
+    }
+    QTest::setBenchmarkResult(qreal(timer.nsecsElapsed()) / calls, QTest::WalltimeNanoseconds);
+}
+
+static void addRows(const char *prefix = nullptr, bool legacy = false)
+{
+    const QByteArray p = prefix ? QByteArray(prefix) + ' ' : QByteArray();
+    QTest::newRow((p + "ns").constData()) << false << legacy;
+    QTest::newRow((p + "allocs").constData()) << true << legacy;
+}
+
+/*
+    The per-reading work, on fixed data: a body composition notification
+    from doc/notes.txt and an APlant advertisement from doc/aplant.md.
+*/
+class Bench : public QObject
+{
+    Q_OBJECT
+
+public:
+    Bench();
+
+private slots:
+    void initTestCase();
+
+    void decodeNotification_data() { comparisonRows("decoder", "hex"); }
+    void decodeNotification();
+    void decodePlantAdvert_data() { comparisonRows("decoder", "settings"); }
+    void decodePlantAdvert();
+    void userCharacteristic_data() { columns(); addRows(); }
+    void userCharacteristic();
+    void identifyUser_data() { columns(); addRows(); }
+    void identifyUser();
+    void lineProtocolBodyComp_data() { comparisonRows("encoder", "arg"); }
+    void lineProtocolBodyComp();
+    void lineProtocolPlant_data() { comparisonRows("encoder", "arg"); }
+    void lineProtocolPlant();
+
+private:
+    static void columns();
+    static void comparisonRows(const char *current, const char *legacy);
+
+private:
+    const QByteArray m_notification;
+    const QByteArray m_plantAdvert;
+    const QBluetoothAddress m_plantAddress;
+    QTemporaryDir m_settingsDir;
+    QScopedPointer<QSettings> m_settings;
+    QScopedPointer<ProfileStore> m_profiles;
+    UserIndex m_userIndex;
+    FrameDecoder::Values m_bodyComp;
+};
+
+Bench::Bench()
+    : m_notification(QByteArray::fromHex("cf01adaa0404015b1e026c1301cd0599")),
+      m_plantAdvert(QByteArray::fromHex("0215b5b182c7eab14988aa99b5c1517008d93a261d15c5")),
+      m_plantAddress(QLatin1String("C4:7C:8D:6A:1B:2E"))
+{
+}
+
+void Bench::columns()
+{
+    QTest::addColumn<bool>("countAllocations");
+    QTest::addColumn<bool>("legacy");
+}
+
+/*!
+    Rows for the \a current code and for the \a legacy code that it
+    replaced, reproduced in the benchmark, to show what was gained.
+*/
+void Bench::comparisonRows(const char *current, const char *legacy)
+{
+    columns();
+    addRows(current);
+    addRows(legacy, true);
+}
+
+void Bench::initTestCase()
+{
+    QVERIFY(m_settingsDir.isValid());
+    m_settings.reset(new QSettings(m_settingsDir.filePath(QLatin1String("bench.ini")), QSettings::IniFormat));
+    m_profiles.reset(new ProfileStore(*m_settings));
+    m_profiles->setAlias(m_plantAddress, QLatin1String("balcony"));
+    m_settings->setValue(QLatin1String("Plants/aplant"), QLatin1String("balcony")); // for the legacy lookup
+
+    QVERIFY(FrameDecoder::decode(FrameDecoder::electronicScale, m_notification, &m_bodyComp));
+    // a household of four, each with a full history of slightly varying readings
+    for (int u = 0; u < 4; ++u) {
+        for (int i = 0; i < 30; ++i) {
+            FrameDecoder::Values v = m_bodyComp;
+            for (int q = 0; q < FrameDecoder::Bmr; ++q)
+                v.value[q] *= 0.8 + 0.15 * u + 0.002 * (i % 7);
+            m_userIndex.add(QStringLiteral("user%1").arg(u), v);
+        }
+    }
+}
+
+void Bench::decodeNotification()
+{
+    QFETCH(bool, legacy);
+    if (legacy) {
+        // as updateBodyComp() used to: via a hex string, a field at a time
+        measure([this]() {
+            const QByteArray hexValue = m_notification.toHex();
+            if (hexValue.length() != 32)
+                return;
+            static const struct { int offset, length; qreal scale; } fields[] = {
+                { 8, 4, 10 }, { 12, 4, 10 }, { 16, 2, 10 }, { 18, 4, 10 }, { 22, 2, 10 }, { 24, 4, 10 }, { 28, 4, 1 }
+            };
+            qreal values[7];
+            for (int i = 0; i < 7; ++i) {
+                bool ok = false;
+                const int val = hexValue.mid(fields[i].offset, fields[i].length).toInt(&ok, 16);
+                if (!ok)
+                    return;
+                values[i] = val / fields[i].scale;
+            }
+            sink += quint64(values[0]);
+        });
+        return;
+    }
+    measure([this]() {
+        FrameDecoder::Values values;
+        FrameDecoder::decode(FrameDecoder::electronicScale, m_notification, &values);
+        sink += values.present;
+    });
+}
+
+void Bench::decodePlantAdvert()
+{
+    QFETCH(bool, legacy);
+    const QString deviceName = QStringLiteral("aplant");
+    if (legacy) {
+        // as decodeIBeaconData() used to: the name from the settings, the values from the end
+        measure([&]() {
+            if (!deviceName.startsWith(QLatin1String("aplant")) || m_plantAdvert.length() != 23)
+                return;
+            m_settings->beginGroup(QLatin1String("Plants"));
+            QString plantName;
+            for (const QString &key : m_settings->childKeys()) {
+                if (deviceName == key)
+                    plantName = m_settings->value(key).toString();
+            }
+            m_settings->endGroup();
+            const int temperature = int(m_plantAdvert[m_plantAdvert.length() - 2]);
+            const int moisture = int(m_plantAdvert[m_plantAdvert.length() - 3]);
+            sink += quint64(temperature + moisture + plantName.size());
+        });
+        return;
+    }
+    QVERIFY(DriverRegistry::instance().matchName(deviceName));
+    measure([&]() {
+        const DeviceDriver *driver = DriverRegistry::instance().matchName(deviceName);
+        FrameDecoder::Values values;
+        FrameDecoder::decode(*driver->advertLayout, m_plantAdvert, &values);
+        sink += values.present + quint64(m_profiles->alias(m_plantAddress, deviceName).size());
+    });
+}
+
+void Bench::userCharacteristic()
+{
+    UserProfile profile;
+    profile.id = 1;
+    profile.height = 180;
+    measure([&]() {
+        sink += quint64(profile.characteristic().size());
+    });
+}
+
+void Bench::identifyUser()
+{
+    measure([this]() {
+        sink += quint64(m_userIndex.identify(m_bodyComp).confidence * 100);
+    });
+}
+
+/*
+    The encoder against the QString::arg() chains that it replaced.
+*/
+void Bench::lineProtocolBodyComp()
+{
+    QFETCH(bool, legacy);
+    Reading reading;
+    reading.measurement = QLatin1String("bodycomp");
+    reading.tagKey = QLatin1String("username");
+    reading.tagValue = QLatin1String("alice");
+    reading.timestamp = Q_INT64_C(1546300800000000000);
+    reading.values = m_bodyComp;
+    if (legacy) {
+        const FrameDecoder::Values &v = reading.values;
+        measure([&]() {
+            QString line = QLatin1String("bodycomp,username=%1 weight=%2,unit=\"%3\",fat=%4,water=%5,muscle=%6,bone=%7,bmr=%8,vfat=%9");
+            line = line.arg(reading.tagValue).arg(v[FrameDecoder::Weight]).arg(QLatin1String("kg"))
+                    .arg(v[FrameDecoder::Fat]).arg(v[FrameDecoder::Water]).arg(v[FrameDecoder::Muscle])
+                    .arg(v[FrameDecoder::Bone]).arg(v[FrameDecoder::Bmr]).arg(v[FrameDecoder::VisceralFat]);
+            sink += quint64(line.toUtf8().size());
+        });
+    } else {
+        LineProtocolEncoder encoder;
+        measure([&]() {
+            encoder.clear();
+            encoder.append(reading);
+            sink += quint64(encoder.size());
+        });
+    }
+}
+
+void Bench::lineProtocolPlant()
+{
+    QFETCH(bool, legacy);
+    Reading reading;
+    reading.measurement = QLatin1String("plants");
+    reading.tagKey = QLatin1String("plant");
+    reading.tagValue = QLatin1String("balcony");
+    reading.timestamp = Q_INT64_C(1546300800000000000);
+    QVERIFY(FrameDecoder::decode(FrameDecoder::aplantBeacon, m_plantAdvert, &reading.values));
+    if (legacy) {
+        const int temperature = int(reading.values[FrameDecoder::Temperature]);
+        const int moisture = int(reading.values[FrameDecoder::Moisture]);
+        measure([&]() {
+            QString line = QLatin1String("plants,plant=%1 temperature=%2,moisture=%3");
+            line = line.arg(reading.tagValue).arg(temperature).arg(moisture);
+            sink += quint64(line.toUtf8().size());
+        });
+    } else {
+        LineProtocolEncoder encoder;
+        measure([&]() {
+            encoder.clear();
+            encoder.append(reading);
+            sink += quint64(encoder.size());
+        });
+    }
+}
+
+QTEST_GUILESS_MAIN(Bench)
+#include "bench.moc"
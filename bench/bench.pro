@@ -0,0 +1,16 @@
+TEMPLATE = app
+TARGET = trayble-bench
+
+# microbenchmarks of the per-reading hot paths; see README.md
+QT -= gui
+QT += testlib
+CONFIG += console testcase
+CONFIG -= app_bundle
+# numbers from a debug build would say little about the real thing
+CONFIG -= debug
+CONFIG += release
+
+include(../core.pri)
+
+SOURCES += \
+    bench.cpp
@@ -0,0 +1,308 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "btsnoopreplay.h"
+#include <QBluetoothUuid>
+#include <QDebug>
+#include <QtEndian>
+#include <cstring>
+
+// btsnoop is the RFC 1761 snoop format with Bluetooth HCI datalink types.
+// All header fields are big-endian; HCI packet contents are little-endian.
+static const char btsnoopMagic[8] = { 'b', 't', 's', 'n', 'o', 'o', 'p', '\0' };
+static const int fileHeaderSize = 16;
+static const int recordHeaderSize = 24;
+static const quint32 datalinkH1 = 1001;    // un-encapsulated HCI; packet type is in the flags
+static const quint32 datalinkH4 = 1002;    // HCI UART; first byte is the packet type
+
+// packets per event loop iteration when replaying as fast as possible
+static const int fastBatchSize = 256;
+
+enum HciPacketType : quint8 {
+    HciCommand = 0x01,
+    HciAcl = 0x02,
+    HciEvent = 0x04
+};
+
+static QBluetoothAddress readAddress(const uchar *p)
+{
+    quint64 addr = 0;
+    for (int i = 5; i >= 0; --i)
+        addr = (addr << 8) | p[i];
+    return QBluetoothAddress(addr);
+}
+
+BtSnoopReplay::BtSnoopReplay(QObject *parent)
+    : QObject(parent)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &BtSnoopReplay::replayNext);
+}
+
+bool BtSnoopReplay::open(const QString &fileName)
+{
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_error = m_file.errorString();
+        return false;
+    }
+    m_size = m_file.size();
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        m_error = m_file.errorString();
+        return false;
+    }
+    if (m_size < fileHeaderSize || memcmp(m_data, btsnoopMagic, sizeof(btsnoopMagic))) {
+        m_error = tr("%1 is not a btsnoop file").arg(fileName);
+        return false;
+    }
+    m_datalink = qFromBigEndian<quint32>(m_data + 12);
+    if (m_datalink != datalinkH1 && m_datalink != datalinkH4) {
+        m_error = tr("unsupported btsnoop datalink type %1").arg(m_datalink);
+        return false;
+    }
+    m_offset = fileHeaderSize;
+    return true;
+}
+
+void BtSnoopReplay::start(bool realTime)
+{
+    m_realTime = realTime;
+    m_clock.start();
+    m_timer.start(0);
+}
+
+bool BtSnoopReplay::readRecord(const uchar **packet, quint32 *length, quint32 *flags, qint64 *timestamp)
+{
+    if (m_offset + recordHeaderSize > m_size)
+        return false;
+    const uchar *h = m_data + m_offset;
+    *length = qFromBigEndian<quint32>(h + 4); // included length
+    *flags = qFromBigEndian<quint32>(h + 8);
+    *timestamp = qFromBigEndian<qint64>(h + 16); // microseconds
+    if (m_offset + recordHeaderSize + *length > m_size)
+        return false;
+    *packet = h + recordHeaderSize;
+    return true;
+}
+
+void BtSnoopReplay::replayNext()
+{
+    int batch = m_realTime ? 1 : fastBatchSize;
+    const uchar *packet;
+    quint32 length, flags;
+    qint64 timestamp;
+    while (readRecord(&packet, &length, &flags, &timestamp)) {
+        if (m_realTime) {
+            if (m_firstTimestamp < 0)
+                m_firstTimestamp = timestamp;
+            const qint64 due = (timestamp - m_firstTimestamp) / 1000 - m_clock.elapsed();
+            if (due > 0) {
+                m_timer.start(int(due));
+                return;
+            }
+        }
+        m_offset += recordHeaderSize + length;
+        ++m_records;
+
+        QElapsedTimer t;
+        t.start();
+        handlePacket(packet, length, flags);
+        const qint64 ns = t.nsecsElapsed();
+        m_processingNs += ns;
+        m_maxProcessingNs = qMax(m_maxProcessingNs, ns);
+
+        if (!m_realTime && --batch == 0) {
+            m_timer.start(0); // let the event loop breathe
+            return;
+        }
+    }
+    qDebug() << "replay finished:" << statistics();
+    emit finished();
+}
+
+void BtSnoopReplay::handlePacket(const uchar *p, quint32 length, quint32 flags)
+{
+    quint8 type;
+    if (m_datalink == datalinkH4) {
+        if (length < 1)
+            return;
+        type = *p++;
+        --length;
+    } else {
+        // bit 0: 1 = received; bit 1: 1 = command or event
+        if (flags & 0x02)
+            type = (flags & 0x01) ? HciEvent : HciCommand;
+        else
+            type = HciAcl;
+    }
+
+    switch (type) {
+    case HciEvent:
+        handleEvent(p, length);
+        break;
+    case HciAcl:
+        if (flags & 0x01) // only what the device sent to us
+            handleAcl(p, length);
+        break;
+    default:
+        break;
+    }
+}
+
+void BtSnoopReplay::handleEvent(const uchar *p, quint32 length)
+{
+    if (length < 2 || quint32(p[1]) + 2 > length)
+        return;
+    const quint8 code = p[0];
+    const uchar *param = p + 2;
+    const int paramLength = p[1];
+
+    if (code == 0x05 && paramLength >= 4) { // Disconnection Complete
+        m_connections.remove(qFromLittleEndian<quint16>(param + 1) & 0x0fff);
+        return;
+    }
+    if (code != 0x3e || paramLength < 1) // LE Meta
+        return;
+
+    const uchar *end = param + paramLength;
+    switch (param[0]) {
+    case 0x01:   // LE Connection Complete
+    case 0x0a: { // LE Enhanced Connection Complete
+        if (paramLength < 12 || param[1] != 0) // status
+            return;
+        const quint16 handle = qFromLittleEndian<quint16>(param + 2) & 0x0fff;
+        const QBluetoothAddress address = readAddress(param + 6);
+        m_connections.insert(handle, address);
+        emit connected(address);
+    } break;
+    case 0x02: { // LE Advertising Report
+        if (paramLength < 2)
+            return;
+        const uchar *r = param + 2;
+        for (int i = 0; i < param[1]; ++i) {
+            // event type, address type, address, data length, data, rssi
+            if (r + 9 > end || r + 9 + r[8] + 1 > end)
+                return;
+            const int dataLength = r[8];
+            handleAdvertisingData(readAddress(r + 2), qint8(r[9 + dataLength]), r + 9, dataLength);
+            r += 9 + dataLength + 1;
+        }
+    } break;
+    case 0x0d: { // LE Extended Advertising Report
+        if (paramLength < 2)
+            return;
+        const uchar *r = param + 2;
+        for (int i = 0; i < param[1]; ++i) {
+            // event type (2), address type, address, phys, sid, tx power, rssi,
+            // periodic interval (2), direct address type, direct address, data length, data
+            if (r + 24 > end || r + 24 + r[23] > end)
+                return;
+            const int dataLength = r[23];
+            handleAdvertisingData(readAddress(r + 3), qint8(r[13]), r + 24, dataLength);
+            r += 24 + dataLength;
+        }
+    } break;
+    default:
+        break;
+    }
+}
+
+void BtSnoopReplay::handleAdvertisingData(const QBluetoothAddress &address, qint8 rssi, const uchar *p, int length)
+{
+    auto it = m_devices.find(address.toUInt64());
+    if (it == m_devices.end()) {
+        it = m_devices.insert(address.toUInt64(), QBluetoothDeviceInfo(address, QString(), 0));
+        it->setCoreConfigurations(QBluetoothDeviceInfo::LowEnergyCoreConfiguration);
+    }
+    QBluetoothDeviceInfo &info = *it;
+    info.setRssi(rssi);
+    QBluetoothDeviceInfo::Fields fields = QBluetoothDeviceInfo::Field::RSSI;
+
+    const uchar *end = p + length;
+    while (p + 1 < end) {
+        const int fieldLength = p[0]; // includes the type byte
+        if (fieldLength == 0 || p + 1 + fieldLength > end)
+            break;
+        const quint8 type = p[1];
+        const uchar *data = p + 2;
+        const int dataLength = fieldLength - 1;
+        switch (type) {
+        case 0x02: // incomplete list of 16-bit service UUIDs
+        case 0x03: { // complete list
+            QList<QBluetoothUuid> uuids;
+            for (int i = 0; i + 1 < dataLength; i += 2)
+                uuids << QBluetoothUuid(qFromLittleEndian<quint16>(data + i));
+            info.setServiceUuids(uuids, type == 0x03 ? QBluetoothDeviceInfo::DataComplete
+                                                     : QBluetoothDeviceInfo::DataIncomplete);
+        } break;
+        case 0x08: // shortened local name
+        case 0x09: // complete local name
+            info.setName(QString::fromUtf8(reinterpret_cast<const char *>(data), dataLength));
+            break;
+        case 0xff: // manufacturer specific: company ID, then data
+            if (dataLength >= 2) {
+                info.setManufacturerData(qFromLittleEndian<quint16>(data),
+                        QByteArray(reinterpret_cast<const char *>(data + 2), dataLength - 2));
+                fields |= QBluetoothDeviceInfo::Field::ManufacturerData;
+            }
+            break;
+        default:
+            break;
+        }
+        p += 1 + fieldLength;
+    }
+
+    ++m_adverts;
+    emit advertisement(info, fields);
+}
+
+void BtSnoopReplay::handleAcl(const uchar *p, quint32 length)
+{
+    // ACL header (4), L2CAP header (4), ATT opcode (1), attribute handle (2)
+    if (length < 11)
+        return;
+    const quint16 handleAndFlags = qFromLittleEndian<quint16>(p);
+    if (((handleAndFlags >> 12) & 0x3) == 0x1) // continuation fragment
+        return;
+    const quint16 l2capLength = qFromLittleEndian<quint16>(p + 4);
+    const quint16 cid = qFromLittleEndian<quint16>(p + 6);
+    if (cid != 0x0004 || l2capLength < 3 || 8u + l2capLength > length) // not ATT, or truncated
+        return;
+    const quint8 opcode = p[8];
+    if (opcode != 0x1b && opcode != 0x1d) // Handle Value Notification / Indication
+        return;
+
+    const QBluetoothAddress address = m_connections.value(handleAndFlags & 0x0fff);
+    if (address.isNull())
+        return;
+    ++m_notifications;
+    emit notification(address, qFromLittleEndian<quint16>(p + 9),
+                      QByteArray(reinterpret_cast<const char *>(p + 11), l2capLength - 3));
+}
+
+QString BtSnoopReplay::statistics() const
+{
+    const qint64 elapsed = qMax(qint64(1), m_clock.elapsed());
+    return tr("%1 records (%2 adverts, %3 notifications) in %4 ms: %5 records/s, "
+              "mean %6 us, max %7 us per record")
+            .arg(m_records).arg(m_adverts).arg(m_notifications).arg(elapsed)
+            .arg(m_records * 1000 / elapsed)
+            .arg(m_records ? m_processingNs / 1000.0 / m_records : 0, 0, 'f', 1)
+            .arg(m_maxProcessingNs / 1000.0, 0, 'f', 1);
+}
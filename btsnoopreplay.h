@@ -0,0 +1,88 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef BTSNOOPREPLAY_H
+#define BTSNOOPREPLAY_H
+
+#include <QBluetoothAddress>
+#include <QBluetoothDeviceInfo>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QTimer>
+
+/*
+    Plays back a btsnoop capture (as written by btmon -w, hcidump or
+    Android's HCI snoop log) as if it were happening live: LE advertising
+    reports become advertisement() signals and ATT notifications become
+    notification() signals.  The file is memory-mapped, but payloads are
+    copied out of the mapping: they are queued for decoding on another
+    thread and may outlive the replay object.
+*/
+class BtSnoopReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BtSnoopReplay(QObject *parent = nullptr);
+
+    bool open(const QString &fileName);
+    QString errorString() const { return m_error; }
+
+    void start(bool realTime = true);
+    QString statistics() const;
+
+signals:
+    void advertisement(const QBluetoothDeviceInfo &device, QBluetoothDeviceInfo::Fields updatedFields);
+    void connected(const QBluetoothAddress &address);
+    void notification(const QBluetoothAddress &address, quint16 handle, const QByteArray &value);
+    void finished();
+
+private slots:
+    void replayNext();
+
+private:
+    bool readRecord(const uchar **packet, quint32 *length, quint32 *flags, qint64 *timestamp);
+    void handlePacket(const uchar *p, quint32 length, quint32 flags);
+    void handleEvent(const uchar *p, quint32 length);
+    void handleAdvertisingData(const QBluetoothAddress &address, qint8 rssi, const uchar *p, int length);
+    void handleAcl(const uchar *p, quint32 length);
+
+private:
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    qint64 m_offset = 0;
+    quint32 m_datalink = 0;
+    QString m_error;
+
+    bool m_realTime = true;
+    qint64 m_firstTimestamp = -1;
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+
+    QHash<quint64, QBluetoothDeviceInfo> m_devices;     // accumulated from adverts and scan responses
+    QHash<quint16, QBluetoothAddress> m_connections;    // ACL connection handle to peer address
+
+    quint64 m_records = 0;
+    quint64 m_adverts = 0;
+    quint64 m_notifications = 0;
+    qint64 m_processingNs = 0;
+    qint64 m_maxProcessingNs = 0;
+};
+
+#endif // BTSNOOPREPLAY_H
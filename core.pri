@@ -0,0 +1,62 @@
+# Everything but the user interface: shared by the tray app (trayble.pro)
+# and the headless daemon (daemon/daemon.pro).
+
+QT += bluetooth network
+
+INCLUDEPATH += $$PWD
+
+HEADERS += $$PWD/trayble.h \
+    $$PWD/advertcache.h \
+    $$PWD/btsnoopreplay.h \
+    $$PWD/csvsink.h \
+    $$PWD/decodestage.h \
+    $$PWD/devicedriver.h \
+    $$PWD/devicesession.h \
+    $$PWD/framedecoder.h \
+    $$PWD/gattcache.h \
+    $$PWD/historysink.h \
+    $$PWD/influxsink.h \
+    $$PWD/influxwriter.h \
+    $$PWD/latencytracker.h \
+    $$PWD/lineprotocol.h \
+    $$PWD/reading.h \
+    $$PWD/profilestore.h \
+    $$PWD/readingsink.h \
+    $$PWD/resourceusage.h \
+    $$PWD/rollupstage.h \
+    $$PWD/rrdsink.h \
+    $$PWD/scanscheduler.h \
+    $$PWD/sinkpipeline.h \
+    $$PWD/spool.h \
+    $$PWD/spscring.h \
+    $$PWD/streamprotocol.h \
+    $$PWD/streamsink.h \
+    $$PWD/timeseriesstore.h \
+    $$PWD/userindex.h
+
+SOURCES += $$PWD/trayble.cpp \
+    $$PWD/advertcache.cpp \
+    $$PWD/btsnoopreplay.cpp \
+    $$PWD/csvsink.cpp \
+    $$PWD/decodestage.cpp \
+    $$PWD/devicedriver.cpp \
+    $$PWD/devicesession.cpp \
+    $$PWD/framedecoder.cpp \
+    $$PWD/gattcache.cpp \
+    $$PWD/historysink.cpp \
+    $$PWD/influxsink.cpp \
+    $$PWD/influxwriter.cpp \
+    $$PWD/latencytracker.cpp \
+    $$PWD/lineprotocol.cpp \
+    $$PWD/profilestore.cpp \
+    $$PWD/readingsink.cpp \
+    $$PWD/resourceusage.cpp \
+    $$PWD/rollupstage.cpp \
+    $$PWD/rrdsink.cpp \
+    $$PWD/scanscheduler.cpp \
+    $$PWD/sinkpipeline.cpp \
+    $$PWD/spool.cpp \
+    $$PWD/streamprotocol.cpp \
+    $$PWD/streamsink.cpp \
+    $$PWD/timeseriesstore.cpp \
+    $$PWD/userindex.cpp
@@ -0,0 +1,87 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "csvsink.h"
+#include <QDateTime>
+#include <QDir>
+
+CsvSink::CsvSink(const QString &directory, QObject *parent)
+    : ReadingSink(QLatin1String("csv"), parent),
+      m_directory(directory)
+{
+}
+
+CsvSink::~CsvSink()
+{
+    close();
+}
+
+static QByteArray quoted(const QString &s)
+{
+    QByteArray ret = s.toUtf8();
+    if (ret.contains(',') || ret.contains('"') || ret.contains('\n'))
+        ret = '"' + ret.replace('"', "\"\"") + '"';
+    return ret;
+}
+
+QFile *CsvSink::file(const Reading &reading)
+{
+    QFile *f = m_files.value(reading.measurement);
+    if (f)
+        return f;
+    QDir().mkpath(m_directory);
+    f = new QFile(m_directory + QLatin1Char('/') + reading.measurement + QLatin1String(".csv"));
+    if (!f->open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        emit error(tr("can't write %1: %2").arg(f->fileName()).arg(f->errorString()));
+        delete f;
+        return nullptr;
+    }
+    if (f->size() == 0) {
+        QByteArray header = "time," + quoted(reading.tagKey) + ",device";
+        for (int q = 0; q < FrameDecoder::QuantityCount; ++q)
+            if (reading.values.has(FrameDecoder::Quantity(q)))
+                header += ',' + QByteArray(FrameDecoder::quantityName(FrameDecoder::Quantity(q)));
+        f->write(header + '\n');
+    }
+    m_files.insert(reading.measurement, f);
+    return f;
+}
+
+bool CsvSink::write(const Reading &reading)
+{
+    QFile *f = file(reading);
+    if (!f)
+        return false;
+    QByteArray line = QDateTime::fromMSecsSinceEpoch(reading.timestamp / 1000000, Qt::UTC)
+            .toString(Qt::ISODateWithMs).toLatin1();
+    line += ',' + quoted(reading.tagValue) + ',' + reading.device.toLatin1();
+    for (int q = 0; q < FrameDecoder::QuantityCount; ++q)
+        if (reading.values.has(FrameDecoder::Quantity(q)))
+            line += ',' + QByteArray::number(reading.values[FrameDecoder::Quantity(q)]);
+    line += '\n';
+    if (f->write(line) != line.size() || !f->flush()) {
+        emit error(tr("can't write %1: %2").arg(f->fileName()).arg(f->errorString()));
+        return false;
+    }
+    return true;
+}
+
+void CsvSink::close()
+{
+    qDeleteAll(m_files);
+    m_files.clear();
+}
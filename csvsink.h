@@ -0,0 +1,49 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef CSVSINK_H
+#define CSVSINK_H
+
+#include <QFile>
+#include <QHash>
+#include "readingsink.h"
+
+/*
+    Appends readings to one CSV file per measurement, with a header row
+    naming the columns when a file is started.
+*/
+class CsvSink : public ReadingSink
+{
+    Q_OBJECT
+
+public:
+    explicit CsvSink(const QString &directory, QObject *parent = nullptr);
+    ~CsvSink();
+
+protected:
+    bool write(const Reading &reading) override;
+    void close() override;
+
+private:
+    QFile *file(const Reading &reading);
+
+private:
+    QString m_directory;
+    QHash<QString, QFile *> m_files;    // by measurement
+};
+
+#endif // CSVSINK_H
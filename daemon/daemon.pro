@@ -0,0 +1,13 @@
+TEMPLATE = app
+TARGET = trayble-daemon
+
+# no widgets, no svg, no tray: just what it takes to collect readings
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG += debug
+
+include(../core.pri)
+
+SOURCES += \
+    main.cpp
@@ -0,0 +1,157 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSocketNotifier>
+#include <csignal>
+#include <cstdio>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "btsnoopreplay.h"
+#include "resourceusage.h"
+#include "trayble.h"
+
+static int signalSockets[2];
+static QtMessageHandler defaultMessageHandler = nullptr;
+
+static void handleSignal(int signal)
+{
+    // nothing but async-signal-safe calls here: the event loop does the rest
+    const char c = char(signal);
+    if (::write(signalSockets[0], &c, 1) != 1)
+        return;
+}
+
+/*!
+    Under systemd, stderr goes to the journal, which takes the priority
+    of each line from a <n> prefix; otherwise Qt's own handler is fine.
+*/
+static void logMessage(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    static const bool journal = qEnvironmentVariableIsSet("JOURNAL_STREAM");
+    if (!journal) {
+        defaultMessageHandler(type, context, message);
+        return;
+    }
+    int priority = 7; // LOG_DEBUG
+    switch (type) {
+    case QtInfoMsg: priority = 6; break;
+    case QtWarningMsg: priority = 4; break;
+    case QtCriticalMsg: priority = 3; break;
+    case QtFatalMsg: priority = 2; break;
+    default: break;
+    }
+    for (const QString &line : qFormatLogMessage(type, context, message).split(QLatin1Char('\n')))
+        fprintf(stderr, "<%d>%s\n", priority, line.toLocal8Bit().constData());
+}
+
+int main(int argc, char *argv[])
+{
+    QElapsedTimer startup;
+    startup.start();
+    defaultMessageHandler = qInstallMessageHandler(logMessage);
+
+    QCoreApplication app(argc, argv);
+    app.setOrganizationDomain(QLatin1String("ecloud.org"));
+    app.setApplicationName(QLatin1String("TrayBLE"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QCoreApplication::translate("main",
+            "Collects readings from BLE devices without a user interface.\n"
+            "SIGTERM or SIGINT stores what's pending and quits; SIGUSR1 logs statistics."));
+    parser.addHelpOption();
+    QCommandLineOption replayOption(QLatin1String("replay"),
+            QCoreApplication::translate("main", "Replay a btsnoop capture instead of using the Bluetooth adapter, then quit."),
+            QLatin1String("file"));
+    parser.addOption(replayOption);
+    QCommandLineOption fastOption(QLatin1String("fast"),
+            QCoreApplication::translate("main", "Replay as fast as possible rather than with the original timing."));
+    parser.addOption(fastOption);
+    parser.process(app);
+
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, signalSockets)) {
+        qCritical("can't create a socket pair for signals");
+        return 1;
+    }
+    QSocketNotifier signalNotifier(signalSockets[1], QSocketNotifier::Read);
+    struct sigaction action = {};
+    action.sa_handler = handleSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGUSR1, &action, nullptr);
+
+    // declared first so that it outlives TrayBle, which may still be decoding what it sent
+    BtSnoopReplay replay;
+    TrayBle trayBle;
+
+    QObject::connect(&signalNotifier, &QSocketNotifier::activated, [&]() {
+        char signal;
+        if (::read(signalSockets[1], &signal, 1) != 1)
+            return;
+        if (signal == SIGUSR1) {
+            qInfo().noquote() << trayBle.statistics();
+        } else {
+            // TrayBle's destructor stores whatever is still pending
+            qInfo("quitting on signal %d", int(signal));
+            app.quit();
+        }
+    });
+    QObject::connect(&trayBle, &TrayBle::error, [](const QString &message) {
+        qWarning().noquote() << message;
+    });
+    QObject::connect(&trayBle, &TrayBle::notify, [](const QString &title, const QString &message) {
+        qInfo().noquote() << title << message;
+    });
+    QObject::connect(&trayBle, &TrayBle::identificationRequested,
+                     [&](quint64, const QString &question, const QString &) {
+        // nobody to ask: the readings are kept (on disk too) until they can be identified
+        qWarning().noquote() << QCoreApplication::translate("main", "can't ask \"%1\" without a user interface; "
+                                                            "the readings are kept until it's answered: add the plant "
+                                                            "alias or user to %2 and restart, or run trayble once")
+                                .arg(question, trayBle.settings().fileName());
+    });
+
+    if (parser.isSet(replayOption)) {
+        if (!replay.open(parser.value(replayOption))) {
+            qWarning() << replay.errorString();
+            return 1;
+        }
+        trayBle.setReplaying(true);
+        QObject::connect(&replay, &BtSnoopReplay::advertisement,
+                         &trayBle, &TrayBle::replayAdvertisement);
+        QObject::connect(&replay, &BtSnoopReplay::connected,
+                         &trayBle, &TrayBle::replayConnected);
+        QObject::connect(&replay, &BtSnoopReplay::notification,
+                         &trayBle, &TrayBle::replayNotification);
+        QObject::connect(&replay, &BtSnoopReplay::finished, [&]() {
+            qInfo().noquote() << replay.statistics() << '\n' << trayBle.statistics();
+            app.quit();
+        });
+        replay.start(!parser.isSet(fastOption));
+    } else {
+        trayBle.deviceSearch();
+    }
+
+    qInfo().noquote() << QCoreApplication::translate("main", "started in %1 ms;").arg(startup.elapsed())
+                      << ResourceUsage::summary();
+    return app.exec();
+}
@@ -0,0 +1,147 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "decodestage.h"
+#include "devicedriver.h"
+#include "rollupstage.h"
+#include "sinkpipeline.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThread>
+
+/*!
+    Takes ownership of \a rollup, which will run on the decoding thread
+    too; \a capacity is how many frames may wait to be decoded.
+*/
+DecodeStage::DecodeStage(RollupStage *rollup, int capacity)
+    : m_queue(capacity),
+      m_drainPosted(0),
+      m_rollup(rollup),
+      m_updateTimer(this),
+      m_decoded(0), m_failed(0), m_busyNs(0)
+{
+    qRegisterMetaType<Reading>();
+    m_rollup->setParent(this);
+    m_updateTimer.setInterval(500);
+    connect(&m_updateTimer, &QTimer::timeout, this, &DecodeStage::sendUpdates);
+    m_rollupStatistics = m_rollup->statistics();
+}
+
+void DecodeStage::start()
+{
+    m_thread = new QThread;
+    m_thread->setObjectName(QLatin1String("decode"));
+    moveToThread(m_thread);
+    connect(m_thread, &QThread::finished, this, &QObject::deleteLater);
+    m_thread->start();
+    QMetaObject::invokeMethod(&m_updateTimer, "start", Qt::QueuedConnection);
+}
+
+/*!
+    Decodes and passes on everything submitted so far, closes the rollup
+    windows and ends the thread, waiting up to \a timeoutMs.  The object
+    deletes itself afterwards.
+*/
+void DecodeStage::stop(int timeoutMs)
+{
+    QMetaObject::invokeMethod(this, "finish", Qt::QueuedConnection);
+    if (m_thread->wait(ulong(timeoutMs)))
+        delete m_thread;
+    else // leave it be rather than pull the rug out from under it
+        qWarning() << "decoding didn't finish in time";
+}
+
+/*!
+    Hands \a frame over to the decoding thread.  Only one thread may
+    submit frames: the one that created the stage.
+*/
+bool DecodeStage::submit(const Frame &frame)
+{
+    if (!m_queue.push(frame))
+        return false;
+    // one event wakes the thread for as many frames as arrive before it runs
+    if (!m_drainPosted.fetchAndStoreOrdered(1))
+        QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+    return true;
+}
+
+bool DecodeStage::submit(const Reading &reading)
+{
+    Frame frame;
+    frame.reading = reading;
+    return submit(frame);
+}
+
+void DecodeStage::drain()
+{
+    // anything submitted after this gets another drain() posted; a full fence, so that
+    // the pops below can't see the queue as it was before the flag cleared
+    m_drainPosted.fetchAndStoreOrdered(0);
+    QElapsedTimer t;
+    t.start();
+    Frame frame;
+    // no more than a ringful at a time, so that the timers get a turn
+    for (int n = m_queue.capacity(); n > 0 && m_queue.pop(&frame); --n) {
+        if (frame.driver) {
+            if (!FrameDecoder::decode(*frame.driver->advertLayout, frame.data, &frame.reading.values)) {
+                m_failed.fetchAndAddRelaxed(1);
+                continue;
+            }
+            m_decoded.fetchAndAddRelaxed(1);
+            frame.data.clear();
+        }
+        if (m_live)
+            m_live->deliver(frame.reading);
+        m_rollup->process(frame.reading);
+        if (!frame.deviceName.isEmpty())
+            m_latest.insert(frame.reading.device, frame);
+    }
+    m_busyNs.fetchAndAddRelaxed(t.nsecsElapsed());
+    if (m_queue.size() && !m_drainPosted.fetchAndStoreOrdered(1))
+        QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+}
+
+void DecodeStage::sendUpdates()
+{
+    for (const Frame &frame : m_latest)
+        emit updated(frame.reading, frame.deviceName);
+    m_latest.clear();
+    const QString s = m_rollup->statistics();
+    QMutexLocker lock(&m_rollupStatisticsMutex);
+    m_rollupStatistics = s;
+}
+
+void DecodeStage::finish()
+{
+    m_updateTimer.stop();
+    do
+        drain();
+    while (m_queue.size());
+    m_rollup->closeAll();
+    sendUpdates();
+    QThread::currentThread()->quit();
+}
+
+QString DecodeStage::statistics() const
+{
+    QString ret = tr("decode: queue %1 of %2 (at most %3), %4 dropped, %5 decoded, %6 failed, %7 ms busy")
+            .arg(m_queue.size()).arg(m_queue.capacity()).arg(m_queue.highWater()).arg(m_queue.droppedCount())
+            .arg(m_decoded.load()).arg(m_failed.load()).arg(m_busyNs.load() / 1000000);
+    QMutexLocker lock(&m_rollupStatisticsMutex);
+    return ret + QLatin1Char('\n') + m_rollupStatistics;
+}
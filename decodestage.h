@@ -0,0 +1,92 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef DECODESTAGE_H
+#define DECODESTAGE_H
+
+#include <QAtomicInteger>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QTimer>
+#include "reading.h"
+#include "spscring.h"
+
+class QThread;
+class RollupStage;
+class SinkPipeline;
+struct DeviceDriver;
+
+/*
+    Decodes advertised frames and passes the readings on through the
+    rollup to the sinks (and, as they are, to the live sinks), on a thread
+    of its own, so that a flood of adverts from dozens of sensors can't
+    make the tray unresponsive.  The Bluetooth
+    side hands frames over through a lock-free ring and never waits: if
+    the ring is full, the frame is dropped and counted.  Only the latest
+    reading from each device comes back for display, at most every
+    updateInterval.
+*/
+class DecodeStage : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Frame {
+        const DeviceDriver *driver = nullptr;   // null if the reading is decoded already
+        QByteArray data;                        // advertised manufacturer data
+        QString deviceName;                     // for display; if empty, it's not displayed
+        Reading reading;                        // everything but the values, until decoded
+    };
+
+    DecodeStage(RollupStage *rollup, int capacity);
+
+    void setUpdateInterval(int ms) { m_updateTimer.setInterval(ms); }
+    void setLivePipeline(SinkPipeline *live) { m_live = live; } // before start()
+
+    void start();
+    void stop(int timeoutMs = 5000);
+    bool submit(const Frame &frame);
+    bool submit(const Reading &reading);
+
+    int queueDepth() const { return m_queue.size(); }
+    QString statistics() const;
+
+signals:
+    void updated(const Reading &reading, const QString &deviceName);
+
+private slots:
+    void drain();
+    void sendUpdates();
+    void finish();
+
+private:
+    SpscRing<Frame> m_queue;
+    QAtomicInt m_drainPosted;
+    RollupStage *m_rollup;
+    SinkPipeline *m_live = nullptr;     // gets every reading, before the rollup
+    QThread *m_thread = nullptr;
+    QTimer m_updateTimer;
+    QHash<QString, Frame> m_latest;     // by device, since the last update
+    QAtomicInteger<quint64> m_decoded;
+    QAtomicInteger<quint64> m_failed;
+    QAtomicInteger<qint64> m_busyNs;
+    mutable QMutex m_rollupStatisticsMutex;
+    QString m_rollupStatistics;         // snapshot, taken on the decoding thread
+};
+
+#endif // DECODESTAGE_H
@@ -0,0 +1,115 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "devicedriver.h"
+
+static DeviceDriver electronicScale()
+{
+    DeviceDriver d;
+    d.name = QLatin1String("Electronic Scale");
+    d.kind = DeviceDriver::Scale;
+    // It also advertises service 0xfff0, but so do lots of unrelated gadgets.
+    d.namePrefixes << QLatin1String("Electronic Scale");
+    d.connectable = true;
+    d.gattService = 0xfff0;
+    d.notificationLayout = &FrameDecoder::electronicScale;
+    return d;
+}
+
+static DeviceDriver aplant()
+{
+    DeviceDriver d;
+    d.name = QLatin1String("aplant");
+    d.kind = DeviceDriver::PlantSensor;
+    // The manufacturer ID is Apple's (iBeacon), so it can't identify the device.
+    d.namePrefixes << QLatin1String("aplant");
+    d.advertManufacturerId = 0x4c;
+    d.advertLayout = &FrameDecoder::aplantBeacon;
+    return d;
+}
+
+static const DeviceDriver builtinDrivers[] = {
+    electronicScale(),
+    aplant()
+};
+
+DriverRegistry::DriverRegistry()
+    : m_nameTrie(1) // root
+{
+    for (const DeviceDriver &d : builtinDrivers)
+        registerDriver(&d);
+}
+
+DriverRegistry &DriverRegistry::instance()
+{
+    static DriverRegistry registry;
+    return registry;
+}
+
+void DriverRegistry::registerDriver(const DeviceDriver *driver)
+{
+    m_drivers.append(driver);
+    for (quint16 id : driver->manufacturerIds)
+        m_byManufacturerId.insert(id, driver);
+    for (quint16 uuid : driver->serviceUuids)
+        m_byServiceUuid.insert(QBluetoothUuid(uuid), driver);
+    for (const QString &pfx : driver->namePrefixes) {
+        int node = 0;
+        for (QChar c : pfx) {
+            int next = m_nameTrie[node].children.value(c, -1);
+            if (next < 0) {
+                next = m_nameTrie.count();
+                m_nameTrie.append(TrieNode());
+                m_nameTrie[node].children.insert(c, next);
+            }
+            node = next;
+        }
+        m_nameTrie[node].driver = driver;
+    }
+}
+
+const DeviceDriver *DriverRegistry::match(const QBluetoothDeviceInfo &device) const
+{
+    if (!m_byManufacturerId.isEmpty()) {
+        for (quint16 id : device.manufacturerIds())
+            if (const DeviceDriver *d = m_byManufacturerId.value(id))
+                return d;
+    }
+    if (!m_byServiceUuid.isEmpty()) {
+        for (const QBluetoothUuid &uuid : device.serviceUuids())
+            if (const DeviceDriver *d = m_byServiceUuid.value(uuid))
+                return d;
+    }
+    return matchName(device.name());
+}
+
+/*!
+    Returns the driver with the longest name prefix matching \a name.
+*/
+const DeviceDriver *DriverRegistry::matchName(const QString &name) const
+{
+    const DeviceDriver *ret = nullptr;
+    int node = 0;
+    for (QChar c : name) {
+        node = m_nameTrie.at(node).children.value(c, -1);
+        if (node < 0)
+            break;
+        if (m_nameTrie.at(node).driver)
+            ret = m_nameTrie.at(node).driver;
+    }
+    return ret;
+}
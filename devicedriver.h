@@ -0,0 +1,86 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef DEVICEDRIVER_H
+#define DEVICEDRIVER_H
+
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+#include "framedecoder.h"
+
+/*
+    Describes one supported type of device: how to recognize it from an
+    advertisement, whether it needs a GATT connection, and how to decode
+    what it sends.
+*/
+struct DeviceDriver {
+    enum Kind {
+        Scale,
+        PlantSensor
+    };
+
+    QString name;
+    Kind kind;
+
+    // ways to recognize the device; any one of them is enough
+    QStringList namePrefixes;
+    QVector<quint16> manufacturerIds;
+    QVector<quint16> serviceUuids;          // advertised 16-bit service UUIDs
+
+    bool connectable = false;               // readings arrive via GATT notifications
+    quint16 gattService = 0;                // service to use once connected
+    const FrameDecoder::Layout *notificationLayout = nullptr;
+
+    quint16 advertManufacturerId = 0;       // readings arrive in advertised manufacturer data
+    const FrameDecoder::Layout *advertLayout = nullptr;
+};
+
+/*
+    Finds the driver for an advertised device.  Manufacturer IDs and service
+    UUIDs are hashed; name prefixes are kept in a trie, so the cost of a
+    lookup depends on the length of the device name, not on the number of
+    registered drivers.
+*/
+class DriverRegistry
+{
+public:
+    static DriverRegistry &instance();
+
+    void registerDriver(const DeviceDriver *driver);
+    const DeviceDriver *match(const QBluetoothDeviceInfo &device) const;
+    const DeviceDriver *matchName(const QString &name) const;
+    const DeviceDriver *matchManufacturerId(quint16 id) const { return m_byManufacturerId.value(id); }
+    const DeviceDriver *matchServiceUuid(const QBluetoothUuid &uuid) const { return m_byServiceUuid.value(uuid); }
+
+private:
+    DriverRegistry();
+
+    struct TrieNode {
+        QHash<QChar, int> children;
+        const DeviceDriver *driver = nullptr;
+    };
+
+    QVector<const DeviceDriver *> m_drivers;
+    QHash<quint16, const DeviceDriver *> m_byManufacturerId;
+    QHash<QBluetoothUuid, const DeviceDriver *> m_byServiceUuid;
+    QVector<TrieNode> m_nameTrie;
+};
+
+#endif // DEVICEDRIVER_H
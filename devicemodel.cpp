@@ -0,0 +1,188 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "devicemodel.h"
+#include <QDateTime>
+#include <algorithm>
+
+DeviceModel::DeviceModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+/*!
+    Sets the latest \a values for \a name (a user, if \a user is true,
+    otherwise a plant), as of \a updated ms since the epoch, or now if
+    it's -1; or adds a row for it.
+*/
+void DeviceModel::update(const QString &name, const QString &values, bool user, qint64 updated)
+{
+    if (updated < 0)
+        updated = QDateTime::currentMSecsSinceEpoch();
+    auto it = m_index.constFind(name);
+    if (it == m_index.constEnd()) {
+        const int row = m_rows.count();
+        beginInsertRows(QModelIndex(), row, row);
+        Row r;
+        r.name = name;
+        r.values = values;
+        r.updated = updated;
+        r.user = user;
+        m_rows.append(r);
+        m_index.insert(name, row);
+        endInsertRows();
+        return;
+    }
+    Row &r = m_rows[*it];
+    r.values = values;
+    r.updated = updated;
+    r.user = r.user || user;
+    emit dataChanged(index(*it, ReadingColumn), index(*it, UpdatedColumn));
+}
+
+void DeviceModel::setPinned(const QString &name, bool pinned)
+{
+    const int row = m_index.value(name, -1);
+    if (row < 0 || m_rows.at(row).pinned == pinned)
+        return;
+    m_rows[row].pinned = pinned;
+    emit dataChanged(index(row, NameColumn), index(row, NameColumn));
+    emit pinnedChanged(name, pinned);
+}
+
+bool DeviceModel::isPinned(const QString &name) const
+{
+    const int row = m_index.value(name, -1);
+    return row >= 0 && m_rows.at(row).pinned;
+}
+
+bool DeviceModel::isUser(const QString &name) const
+{
+    const int row = m_index.value(name, -1);
+    return row >= 0 && m_rows.at(row).user;
+}
+
+QString DeviceModel::values(const QString &name) const
+{
+    const int row = m_index.value(name, -1);
+    return row >= 0 ? m_rows.at(row).values : QString();
+}
+
+QStringList DeviceModel::pinned() const
+{
+    QStringList ret;
+    for (const Row &r : m_rows)
+        if (r.pinned)
+            ret << r.name;
+    return ret;
+}
+
+/*!
+    The names of the \a count rows updated most recently, most recent first.
+*/
+QStringList DeviceModel::mostRecent(int count) const
+{
+    QVector<const Row *> rows;
+    rows.reserve(m_rows.count());
+    for (const Row &r : m_rows)
+        rows << &r;
+    count = qMin(count, rows.count());
+    std::partial_sort(rows.begin(), rows.begin() + count, rows.end(),
+                      [](const Row *a, const Row *b) { return a->updated > b->updated; });
+    QStringList ret;
+    for (int i = 0; i < count; ++i)
+        ret << rows.at(i)->name;
+    return ret;
+}
+
+int DeviceModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_rows.count();
+}
+
+int DeviceModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant DeviceModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_rows.count())
+        return QVariant();
+    const Row &r = m_rows.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+        switch (index.column()) {
+        case NameColumn:
+            return r.name;
+        case ReadingColumn:
+            return r.values;
+        case UpdatedColumn:
+            return r.updated ? QDateTime::fromMSecsSinceEpoch(r.updated).toString(Qt::SystemLocaleShortDate)
+                             : QString();
+        }
+        break;
+    case Qt::CheckStateRole:
+        if (index.column() == NameColumn)
+            return r.pinned ? Qt::Checked : Qt::Unchecked;
+        break;
+    case Qt::ToolTipRole:
+        if (index.column() == NameColumn)
+            return tr("pinned to the tray menu");
+        break;
+    case SortRole:
+        if (index.column() == UpdatedColumn)
+            return r.updated;
+        return data(index, Qt::DisplayRole);
+    case UpdatedRole:
+        return r.updated;
+    case IsUserRole:
+        return r.user;
+    }
+    return QVariant();
+}
+
+bool DeviceModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || index.column() != NameColumn || role != Qt::CheckStateRole)
+        return false;
+    setPinned(m_rows.at(index.row()).name, value.toInt() == Qt::Checked);
+    return true;
+}
+
+Qt::ItemFlags DeviceModel::flags(const QModelIndex &index) const
+{
+    Qt::ItemFlags ret = QAbstractTableModel::flags(index);
+    if (index.column() == NameColumn)
+        ret |= Qt::ItemIsUserCheckable;
+    return ret;
+}
+
+QVariant DeviceModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QVariant();
+    switch (section) {
+    case NameColumn:
+        return tr("Name");
+    case ReadingColumn:
+        return tr("Latest reading");
+    case UpdatedColumn:
+        return tr("Updated");
+    }
+    return QVariant();
+}
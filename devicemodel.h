@@ -0,0 +1,74 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef DEVICEMODEL_H
+#define DEVICEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QHash>
+#include <QVector>
+
+/*
+    The latest reading from every user and plant seen, one row each, for
+    DeviceWindow and the tray menu.  Rows are only ever appended or
+    changed in place, so an update costs one hash lookup and one
+    dataChanged(), however many devices there are.  Sort by UpdatedRole
+    for the time of the last reading.
+*/
+class DeviceModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column { NameColumn, ReadingColumn, UpdatedColumn, ColumnCount };
+    enum Role { UpdatedRole = Qt::UserRole, IsUserRole, SortRole };
+
+    explicit DeviceModel(QObject *parent = nullptr);
+
+    void update(const QString &name, const QString &values, bool user, qint64 updated = -1);
+    void setPinned(const QString &name, bool pinned);
+    bool contains(const QString &name) const { return m_index.contains(name); }
+    bool isPinned(const QString &name) const;
+    bool isUser(const QString &name) const;
+    QString values(const QString &name) const;
+    QStringList pinned() const;
+    QStringList mostRecent(int count) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role) override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+signals:
+    void pinnedChanged(const QString &name, bool pinned);
+
+private:
+    struct Row {
+        QString name;
+        QString values;
+        qint64 updated = 0;     // ms since the epoch; 0 if not since starting
+        bool user = false;
+        bool pinned = false;
+    };
+
+    QVector<Row> m_rows;
+    QHash<QString, int> m_index;    // row by name
+};
+
+#endif // DEVICEMODEL_H
@@ -0,0 +1,312 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "devicesession.h"
+#include "devicedriver.h"
+#include "reading.h"
+#include <QDebug>
+#include <QMetaEnum>
+
+DeviceSession::DeviceSession(const QBluetoothDeviceInfo &device, const DeviceDriver *driver,
+                             GattCache *gattCache, LatencyTracker *latency, QObject *parent)
+    : QObject(parent),
+      m_device(device),
+      m_address(device.address().toString()),
+      m_driver(driver),
+      m_gattCache(gattCache),
+      m_latency(latency)
+{
+    m_timeout.setSingleShot(true);
+    m_timeout.setInterval(60000);
+    connect(&m_timeout, &QTimer::timeout, this, [this]() {
+        abort(tr("no reading from %1; giving up").arg(m_device.name()));
+    });
+    m_controller = QLowEnergyController::createCentral(device, this);
+    connect(m_controller, SIGNAL(serviceDiscovered(QBluetoothUuid)),
+            this, SLOT(serviceDiscovered(QBluetoothUuid)));
+    connect(m_controller, SIGNAL(discoveryFinished()),
+            this, SLOT(serviceScanDone()));
+    connect(m_controller, SIGNAL(error(QLowEnergyController::Error)),
+            this, SLOT(controllerError(QLowEnergyController::Error)));
+    connect(m_controller, SIGNAL(connected()),
+            this, SLOT(deviceConnected()));
+    connect(m_controller, SIGNAL(disconnected()),
+            this, SLOT(deviceDisconnected()));
+}
+
+DeviceSession::~DeviceSession()
+{
+    delete m_service;
+}
+
+void DeviceSession::connectToDevice(const QByteArray &userProfile)
+{
+    m_userProfile = userProfile;
+    m_cached = m_gattCache->lookup(m_device.address(), GattCache::identity(m_device));
+    m_timeout.start();
+    m_controller->connectToDevice();
+}
+
+void DeviceSession::deviceConnected()
+{
+    qDebug() << m_controller->remoteName();
+    m_latency->mark(m_address, LatencyTracker::Connected);
+    m_receivedReading = false;
+    m_controller->discoverServices();
+}
+
+void DeviceSession::deviceDisconnected()
+{
+    qDebug() << m_controller->remoteName() << m_controller->state();
+    emit statusChanged(tr("%1 disconnected").arg(m_controller->remoteName()));
+    finish();
+}
+
+void DeviceSession::controllerError(QLowEnergyController::Error e)
+{
+    static QMetaEnum menum = m_controller->metaObject()->enumerator(
+                m_controller->metaObject()->indexOfEnumerator("Error"));
+    emit statusChanged(tr("controller error: %1").arg(menum.valueToKey(e)));
+    // an error before the connection is established never leads to disconnected()
+    if (m_controller->state() == QLowEnergyController::UnconnectedState)
+        finish();
+}
+
+/*!
+    Gives up on the device: disconnects, or if not connected, finishes
+    right away.
+*/
+void DeviceSession::abort(const QString &message)
+{
+    emit statusChanged(message);
+    m_timeout.stop();
+    if (m_controller->state() == QLowEnergyController::UnconnectedState)
+        finish();
+    else
+        m_controller->disconnectFromDevice(); // finishes in deviceDisconnected()
+}
+
+void DeviceSession::finish()
+{
+    m_timeout.stop();
+    if (m_finished)
+        return;
+    m_finished = true;
+    emit finished(this);
+}
+
+void DeviceSession::serviceDiscovered(const QBluetoothUuid &svc)
+{
+    qDebug() << m_controller->remoteName() << ": discovered service" << svc << hex << svc.toUInt16();
+    if (svc.toUInt16() == m_driver->gattService) {
+        m_serviceUuid = svc;
+        m_latency->mark(m_address, LatencyTracker::ServiceFound);
+    }
+    // if we know this device, there's no need to wait for the rest of the services
+    if (m_cached.isValid() && svc == m_cached.service && !m_service)
+        createService();
+}
+
+void DeviceSession::serviceScanDone()
+{
+    qDebug() << m_controller->remoteName();
+    m_latency->mark(m_address, LatencyTracker::ServicesDone);
+
+    if (m_service) // already created from the cache
+        return;
+
+    if (m_serviceUuid.isNull()) {
+        abort(tr("no known service on ") + m_controller->remoteName());
+        return;
+    }
+
+    createService();
+}
+
+void DeviceSession::createService()
+{
+    emit statusChanged(tr("connecting..."));
+    m_service = m_controller->createServiceObject(m_serviceUuid, this);
+
+    if (!m_service) {
+        abort(tr("failed to connect to ") + m_controller->remoteName());
+        return;
+    }
+
+    connect(m_service, SIGNAL(stateChanged(QLowEnergyService::ServiceState)),
+            this, SLOT(serviceStateChanged(QLowEnergyService::ServiceState)));
+    connect(m_service, SIGNAL(characteristicChanged(QLowEnergyCharacteristic,QByteArray)),
+            this, SLOT(characteristicChanged(QLowEnergyCharacteristic,QByteArray)));
+    connect(m_service, SIGNAL(error(QLowEnergyService::ServiceError)),
+            this, SLOT(serviceError(QLowEnergyService::ServiceError)));
+
+    m_service->discoverDetails();
+}
+
+void DeviceSession::disconnectService()
+{
+    // disable notifications before disconnecting
+    if (m_notification.isValid() && m_service
+            && m_notification.value() == QByteArray::fromHex("0100")) {
+        m_service->writeDescriptor(m_notification, QByteArray::fromHex("0000"));
+    } else {
+        m_controller->disconnectFromDevice();
+        delete m_service;
+        m_service = nullptr;
+    }
+}
+
+void DeviceSession::sendRequest(const QByteArray &userProfile)
+{
+    m_userProfile = userProfile;
+    if (m_service && m_service->state() == QLowEnergyService::ServiceDiscovered)
+        writeRequest();
+}
+
+void DeviceSession::writeRequest()
+{
+    if (m_cached.isValid() && writeCachedRequest()) {
+        m_latency->mark(m_address, LatencyTracker::RequestSent);
+        return;
+    }
+
+    GattCacheEntry entry;
+    entry.identity = GattCache::identity(m_device);
+    entry.service = m_serviceUuid;
+    for (const QLowEnergyCharacteristic &characteristic : m_service->characteristics()) {
+        qDebug() << "   characteristic " << hex << characteristic.handle() << characteristic.name() << characteristic.properties();
+
+        switch (characteristic.properties()) {
+        case QLowEnergyCharacteristic::Write: {
+            // Send user preferences (even though we aren't sure which user this is, yet).
+            // Merely subscribing for notifications without writing to this characteristic
+            // seems not to be enough to get a weight reading.
+            m_service->writeCharacteristic(characteristic, m_userProfile);
+            entry.writeCharacteristic = characteristic.uuid();
+            entry.writeHandle = characteristic.handle();
+        } break;
+        case QLowEnergyCharacteristic::Notify: {
+            m_notification = characteristic.descriptor(QBluetoothUuid::ClientCharacteristicConfiguration);
+            if (!m_notification.isValid()) {
+                qWarning() << "invalid notification descriptor";
+                return;
+            }
+
+            // enable notification
+            m_service->writeDescriptor(m_notification, QByteArray::fromHex("0100"));
+            entry.notifyCharacteristic = characteristic.uuid();
+            entry.notifyHandle = characteristic.handle();
+            entry.notifyDescriptorHandle = m_notification.handle();
+        }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (entry.isValid()) {
+        m_gattCache->store(m_device.address(), entry);
+        m_cached = entry;
+    }
+    m_latency->mark(m_address, LatencyTracker::RequestSent);
+}
+
+/*!
+    Writes the user profile and enables notifications using the
+    characteristics remembered from last time, without looking through the
+    rest.  Returns false if they no longer match what the device has.
+*/
+bool DeviceSession::writeCachedRequest()
+{
+    const QLowEnergyCharacteristic notify = m_service->characteristic(m_cached.notifyCharacteristic);
+    const QLowEnergyDescriptor descriptor = notify.descriptor(QBluetoothUuid::ClientCharacteristicConfiguration);
+    if (!notify.isValid() || notify.handle() != m_cached.notifyHandle
+            || !descriptor.isValid() || descriptor.handle() != m_cached.notifyDescriptorHandle) {
+        forgetCache();
+        return false;
+    }
+
+    QLowEnergyCharacteristic write;
+    if (!m_cached.writeCharacteristic.isNull()) {
+        write = m_service->characteristic(m_cached.writeCharacteristic);
+        if (!write.isValid() || write.handle() != m_cached.writeHandle) {
+            forgetCache();
+            return false;
+        }
+    }
+
+    qDebug() << m_address << "using cached handles" << hex << m_cached.writeHandle << m_cached.notifyDescriptorHandle;
+    if (write.isValid())
+        m_service->writeCharacteristic(write, m_userProfile);
+    m_notification = descriptor;
+    m_service->writeDescriptor(m_notification, QByteArray::fromHex("0100"));
+    return true;
+}
+
+void DeviceSession::forgetCache()
+{
+    qDebug() << m_address << "cached GATT handles are stale";
+    m_gattCache->invalidate(m_device.address());
+    m_cached = GattCacheEntry();
+}
+
+void DeviceSession::serviceStateChanged(QLowEnergyService::ServiceState s)
+{
+    switch (s) {
+    case QLowEnergyService::ServiceDiscovered:
+        m_latency->mark(m_address, LatencyTracker::DetailsDiscovered);
+        writeRequest();
+        break;
+    default:
+        break;
+    }
+}
+
+void DeviceSession::serviceError(QLowEnergyService::ServiceError e)
+{
+    static QMetaEnum menum = m_service->metaObject()->enumerator(
+                m_service->metaObject()->indexOfEnumerator("ServiceError"));
+    emit statusChanged(tr("service error: %1").arg(menum.valueToKey(e)));
+
+    // a write to a remembered handle failed: do it the long way
+    if (m_cached.isValid() && (e == QLowEnergyService::CharacteristicWriteError
+                               || e == QLowEnergyService::DescriptorWriteError)) {
+        forgetCache();
+        writeRequest();
+    }
+}
+
+void DeviceSession::characteristicChanged(const QLowEnergyCharacteristic &c, const QByteArray &value)
+{
+    if (m_receivedReading)
+        return;
+    const qint64 timestamp = Reading::now();
+    qDebug() << m_address << c.name() << value.toHex();
+
+    FrameDecoder::Values values;
+    const FrameDecoder::Layout &layout = *m_driver->notificationLayout;
+    if (value.size() != layout.length) {
+        emit statusChanged(tr("reading has unexpected length"));
+    } else if (!FrameDecoder::decode(layout, value, &values)) {
+        emit statusChanged(tr("failed to decode reading"));
+    } else {
+        m_receivedReading = true;
+        m_timeout.stop(); // the scale disconnects when it's done
+        m_latency->mark(m_address, LatencyTracker::FirstReading);
+        emit readingReceived(this, values, timestamp);
+    }
+}
@@ -0,0 +1,97 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef DEVICESESSION_H
+#define DEVICESESSION_H
+
+#include <QBluetoothDeviceInfo>
+#include <QLowEnergyController>
+#include <QLowEnergyService>
+#include <QTimer>
+#include "framedecoder.h"
+#include "gattcache.h"
+#include "latencytracker.h"
+
+struct DeviceDriver;
+
+/*
+    One GATT connection to one device: owns the controller, the service
+    object, the notification descriptor and the decode state, so that
+    several devices can be connected at the same time.  A session that
+    finds nothing useful on the device, or hasn't had a reading within the
+    timeout, disconnects rather than hold on to a connection slot.
+*/
+class DeviceSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    DeviceSession(const QBluetoothDeviceInfo &device, const DeviceDriver *driver,
+                  GattCache *gattCache, LatencyTracker *latency, QObject *parent = nullptr);
+    ~DeviceSession();
+
+    QString address() const { return m_address; }
+    QString name() const { return m_device.name(); }
+    const DeviceDriver *driver() const { return m_driver; }
+
+    void connectToDevice(const QByteArray &userProfile);
+    void sendRequest(const QByteArray &userProfile);
+    void disconnectService();
+    void setTimeout(int ms) { m_timeout.setInterval(ms); }
+
+signals:
+    void statusChanged(QString message);
+    void readingReceived(DeviceSession *session, const FrameDecoder::Values &values, qint64 timestamp);
+    void finished(DeviceSession *session);
+
+private slots:
+    void deviceConnected();
+    void deviceDisconnected();
+    void controllerError(QLowEnergyController::Error e);
+    void serviceDiscovered(const QBluetoothUuid &svc);
+    void serviceScanDone();
+
+    void serviceStateChanged(QLowEnergyService::ServiceState s);
+    void characteristicChanged(const QLowEnergyCharacteristic &c, const QByteArray &value);
+    void serviceError(QLowEnergyService::ServiceError e);
+
+private:
+    void createService();
+    void writeRequest();
+    bool writeCachedRequest();
+    void forgetCache();
+    void abort(const QString &message);
+    void finish();
+
+private:
+    QBluetoothDeviceInfo m_device;
+    QString m_address;
+    const DeviceDriver *m_driver;
+    GattCache *m_gattCache;
+    GattCacheEntry m_cached;
+    LatencyTracker *m_latency;
+    QLowEnergyController *m_controller = nullptr;
+    QLowEnergyService *m_service = nullptr;
+    QBluetoothUuid m_serviceUuid;
+    QLowEnergyDescriptor m_notification;
+    QByteArray m_userProfile;
+    bool m_receivedReading = false;
+    bool m_finished = false;
+    QTimer m_timeout;
+};
+
+#endif // DEVICESESSION_H
@@ -0,0 +1,133 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "devicewindow.h"
+#include "devicemodel.h"
+#include <QComboBox>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLineEdit>
+#include <QMenu>
+#include <QTableView>
+#include <QVBoxLayout>
+
+DeviceFilter::DeviceFilter(QObject *parent)
+    : QSortFilterProxyModel(parent)
+{
+}
+
+void DeviceFilter::setKind(Kind kind)
+{
+    m_kind = kind;
+    invalidateFilter();
+}
+
+void DeviceFilter::setText(const QString &text)
+{
+    m_text = text;
+    invalidateFilter();
+}
+
+bool DeviceFilter::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+    const QAbstractItemModel *model = sourceModel();
+    const QModelIndex name = model->index(sourceRow, DeviceModel::NameColumn, sourceParent);
+    switch (m_kind) {
+    case Users:
+        if (!name.data(DeviceModel::IsUserRole).toBool())
+            return false;
+        break;
+    case Plants:
+        if (name.data(DeviceModel::IsUserRole).toBool())
+            return false;
+        break;
+    case Pinned:
+        if (name.data(Qt::CheckStateRole).toInt() != Qt::Checked)
+            return false;
+        break;
+    case All:
+        break;
+    }
+    if (m_text.isEmpty())
+        return true;
+    return name.data().toString().contains(m_text, Qt::CaseInsensitive)
+            || model->index(sourceRow, DeviceModel::ReadingColumn, sourceParent).data().toString()
+               .contains(m_text, Qt::CaseInsensitive);
+}
+
+DeviceWindow::DeviceWindow(DeviceModel *model, QWidget *parent)
+    : QWidget(parent),
+      m_model(model),
+      m_search(new QLineEdit),
+      m_kind(new QComboBox),
+      m_view(new QTableView)
+{
+    setWindowTitle(tr("Devices"));
+
+    m_filter.setSourceModel(m_model);
+    m_filter.setSortRole(DeviceModel::SortRole);
+    m_filter.setDynamicSortFilter(true);
+
+    m_search->setPlaceholderText(tr("Search"));
+    m_search->setClearButtonEnabled(true);
+    connect(m_search, &QLineEdit::textChanged, &m_filter, &DeviceFilter::setText);
+    m_kind->addItems(QStringList() << tr("All") << tr("Users") << tr("Plants") << tr("Pinned"));
+    connect(m_kind, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](int kind) {
+        m_filter.setKind(DeviceFilter::Kind(kind));
+    });
+
+    m_view->setModel(&m_filter);
+    m_view->setSortingEnabled(true);
+    m_view->sortByColumn(DeviceModel::UpdatedColumn, Qt::DescendingOrder);
+    m_view->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_view->setAlternatingRowColors(true);
+    m_view->setWordWrap(false);
+    // with fixed row heights, nothing has to measure rows that aren't visible
+    m_view->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    m_view->verticalHeader()->setDefaultSectionSize(m_view->fontMetrics().height() + 6);
+    m_view->verticalHeader()->hide();
+    m_view->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
+    m_view->horizontalHeader()->setStretchLastSection(true);
+    m_view->setColumnWidth(DeviceModel::NameColumn, 160);
+    m_view->setColumnWidth(DeviceModel::ReadingColumn, 360);
+    connect(m_view, &QTableView::doubleClicked, this, [this](const QModelIndex &index) {
+        const QModelIndex name = index.sibling(index.row(), DeviceModel::NameColumn);
+        if (name.data(DeviceModel::IsUserRole).toBool())
+            emit settingsRequested(name.data().toString());
+    });
+    m_view->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(m_view, &QWidget::customContextMenuRequested, this, [this](const QPoint &pos) {
+        const QModelIndex index = m_view->indexAt(pos);
+        if (!index.isValid())
+            return;
+        const QModelIndex name = index.sibling(index.row(), DeviceModel::NameColumn);
+        const QString context = name.data().toString();
+        QMenu menu;
+        menu.addAction(tr("History"), this, [this, context]() { emit historyRequested(context); });
+        if (name.data(DeviceModel::IsUserRole).toBool())
+            menu.addAction(tr("Settings"), this, [this, context]() { emit settingsRequested(context); });
+        menu.exec(m_view->viewport()->mapToGlobal(pos));
+    });
+
+    QHBoxLayout *top = new QHBoxLayout;
+    top->addWidget(m_search, 1);
+    top->addWidget(m_kind);
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addLayout(top);
+    layout->addWidget(m_view);
+    resize(720, 480);
+}
@@ -0,0 +1,77 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef DEVICEWINDOW_H
+#define DEVICEWINDOW_H
+
+#include <QSortFilterProxyModel>
+#include <QWidget>
+
+class DeviceModel;
+class QComboBox;
+class QLineEdit;
+class QTableView;
+
+/*
+    Filters DeviceModel rows by kind (users, plants or pinned ones) and by
+    text found in the name or the reading.
+*/
+class DeviceFilter : public QSortFilterProxyModel
+{
+    Q_OBJECT
+
+public:
+    enum Kind { All, Users, Plants, Pinned };
+
+    explicit DeviceFilter(QObject *parent = nullptr);
+
+    void setKind(Kind kind);
+    void setText(const QString &text);
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const override;
+
+private:
+    Kind m_kind = All;
+    QString m_text;
+};
+
+/*
+    All the users and plants seen, with their latest readings, in a table
+    that can be sorted, filtered and searched; for when there are too many
+    for the tray menu.  Ticking a name pins it to the tray menu.
+*/
+class DeviceWindow : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit DeviceWindow(DeviceModel *model, QWidget *parent = nullptr);
+
+signals:
+    void settingsRequested(const QString &user);
+    void historyRequested(const QString &context);
+
+private:
+    DeviceModel *m_model;
+    DeviceFilter m_filter;
+    QLineEdit *m_search;
+    QComboBox *m_kind;
+    QTableView *m_view;
+};
+
+#endif // DEVICEWINDOW_H
@@ -0,0 +1,96 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "framedecoder.h"
+
+namespace FrameDecoder {
+
+// example cf01adaa 0405 015a 1b 0269 13 01cd 0599
+//         not sure, weight, fat, bone, muscle, visceral fat, water, BMR
+static const Field electronicScaleFields[] = {
+    { Weight,       4,  2, false, BigEndian, 10 },
+    { Fat,          6,  2, false, BigEndian, 10 },
+    { Bone,         8,  1, false, BigEndian, 10 },
+    { Muscle,       9,  2, false, BigEndian, 10 },
+    { VisceralFat,  11, 1, false, BigEndian, 10 },
+    { Water,        12, 2, false, BigEndian, 10 },
+    { Bmr,          14, 2, false, BigEndian, 1 },
+};
+
+// iBeacon: 02 15, 16-byte proximity UUID, major, minor, signal power.
+// APlant puts moisture in the high byte of minor and temperature in the low byte.
+static const Field aplantBeaconFields[] = {
+    { Moisture,     20, 1, false, BigEndian, 1 },
+    { Temperature,  21, 1, true,  BigEndian, 1 },
+};
+
+const Layout electronicScale = { "Electronic Scale", 16, electronicScaleFields,
+                                 int(sizeof(electronicScaleFields) / sizeof(Field)) };
+const Layout aplantBeacon = { "aplant", 23, aplantBeaconFields,
+                              int(sizeof(aplantBeaconFields) / sizeof(Field)) };
+
+const char *quantityName(Quantity q)
+{
+    static const char *names[QuantityCount] = {
+        "weight", "fat", "bone", "muscle", "vfat", "water", "bmr", "temperature", "moisture"
+    };
+    return q < QuantityCount ? names[q] : "";
+}
+
+qreal resolution(Quantity q)
+{
+    qreal ret = 0;
+    for (const Layout *layout : { &electronicScale, &aplantBeacon })
+        for (int i = 0; i < layout->fieldCount; ++i)
+            if (layout->fields[i].quantity == q)
+                ret = qMax(ret, layout->fields[i].scale);
+    return ret;
+}
+
+static inline qint64 readField(const uchar *p, const Field &f)
+{
+    quint32 raw = 0;
+    if (f.endian == BigEndian) {
+        for (int i = 0; i < f.width; ++i)
+            raw = (raw << 8) | p[i];
+    } else {
+        for (int i = f.width - 1; i >= 0; --i)
+            raw = (raw << 8) | p[i];
+    }
+    if (f.isSigned) {
+        const int shift = 32 - 8 * f.width;
+        return qint32(raw << shift) >> shift; // sign-extend
+    }
+    return raw;
+}
+
+bool decode(const Layout &layout, const char *data, int length, Values *out)
+{
+    if (length != layout.length)
+        return false;
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    for (int i = 0; i < layout.fieldCount; ++i) {
+        const Field &f = layout.fields[i];
+        if (f.offset + f.width > length)
+            return false;
+        out->value[f.quantity] = readField(p + f.offset, f) / f.scale;
+        out->present |= 1u << f.quantity;
+    }
+    return true;
+}
+
+} // namespace FrameDecoder
@@ -0,0 +1,86 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+/*
+    Decodes sensor values directly from the raw bytes of a BLE notification
+    or advertisement, according to a static table describing where each
+    field lives in the frame.  Supporting another device model means adding
+    another Layout; no string parsing is involved.
+*/
+namespace FrameDecoder {
+
+enum Quantity {
+    Weight,
+    Fat,
+    Bone,
+    Muscle,
+    VisceralFat,
+    Water,
+    Bmr,
+    Temperature,
+    Moisture,
+    QuantityCount
+};
+
+enum Endian : quint8 { BigEndian, LittleEndian };
+
+struct Field {
+    Quantity quantity;
+    quint8 offset;
+    quint8 width;   // bytes: 1, 2 or 4
+    bool isSigned;
+    Endian endian;
+    qreal scale;    // decoded value = raw integer / scale
+};
+
+struct Layout {
+    const char *name;
+    int length;     // expected frame length in bytes
+    const Field *fields;
+    int fieldCount;
+};
+
+struct Values {
+    qreal value[QuantityCount] = {};
+    quint32 present = 0;
+
+    bool has(Quantity q) const { return present & (1u << q); }
+    qreal operator[](Quantity q) const { return value[q]; }
+};
+
+const char *quantityName(Quantity q);
+qreal resolution(Quantity q);   // finest scale any known layout decodes it with; 0 if none
+
+bool decode(const Layout &layout, const char *data, int length, Values *out);
+inline bool decode(const Layout &layout, const QByteArray &frame, Values *out)
+{
+    return decode(layout, frame.constData(), frame.size(), out);
+}
+
+// Known frame layouts
+extern const Layout electronicScale;    // body composition notification on 0xfff4
+extern const Layout aplantBeacon;       // APlant iBeacon manufacturer data (ID 0x4c)
+
+} // namespace FrameDecoder
+
+#endif // FRAMEDECODER_H
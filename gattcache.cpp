@@ -0,0 +1,82 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "gattcache.h"
+
+/*!
+    Returns a string that changes if the device is replaced or its firmware
+    presents itself differently: the advertised name, services and
+    manufacturer IDs.  (The scales we know of predate the Bluetooth 5.1
+    Database Hash characteristic, which would be the better key.)
+*/
+QString GattCache::identity(const QBluetoothDeviceInfo &device)
+{
+    QStringList parts;
+    parts << device.name();
+    QStringList services;
+    for (const QBluetoothUuid &uuid : device.serviceUuids())
+        services << uuid.toString();
+    services.sort();
+    parts << services.join(QLatin1Char(','));
+    QStringList manufacturers;
+    for (quint16 id : device.manufacturerIds())
+        manufacturers << QString::number(id, 16);
+    manufacturers.sort();
+    parts << manufacturers.join(QLatin1Char(','));
+    return parts.join(QLatin1Char(';'));
+}
+
+GattCacheEntry GattCache::lookup(const QBluetoothAddress &address, const QString &identity)
+{
+    GattCacheEntry ret;
+    m_settings.beginGroup(QLatin1String("GattCache"));
+    m_settings.beginGroup(key(address));
+    if (m_settings.value(QLatin1String("identity")).toString() == identity) {
+        ret.identity = identity;
+        ret.service = QBluetoothUuid(m_settings.value(QLatin1String("service")).toString());
+        ret.writeCharacteristic = QBluetoothUuid(m_settings.value(QLatin1String("writeCharacteristic")).toString());
+        ret.notifyCharacteristic = QBluetoothUuid(m_settings.value(QLatin1String("notifyCharacteristic")).toString());
+        ret.writeHandle = m_settings.value(QLatin1String("writeHandle")).toUInt();
+        ret.notifyHandle = m_settings.value(QLatin1String("notifyHandle")).toUInt();
+        ret.notifyDescriptorHandle = m_settings.value(QLatin1String("notifyDescriptorHandle")).toUInt();
+    }
+    m_settings.endGroup();
+    m_settings.endGroup();
+    return ret;
+}
+
+void GattCache::store(const QBluetoothAddress &address, const GattCacheEntry &entry)
+{
+    m_settings.beginGroup(QLatin1String("GattCache"));
+    m_settings.beginGroup(key(address));
+    m_settings.setValue(QLatin1String("identity"), entry.identity);
+    m_settings.setValue(QLatin1String("service"), entry.service.toString());
+    m_settings.setValue(QLatin1String("writeCharacteristic"), entry.writeCharacteristic.toString());
+    m_settings.setValue(QLatin1String("notifyCharacteristic"), entry.notifyCharacteristic.toString());
+    m_settings.setValue(QLatin1String("writeHandle"), entry.writeHandle);
+    m_settings.setValue(QLatin1String("notifyHandle"), entry.notifyHandle);
+    m_settings.setValue(QLatin1String("notifyDescriptorHandle"), entry.notifyDescriptorHandle);
+    m_settings.endGroup();
+    m_settings.endGroup();
+}
+
+void GattCache::invalidate(const QBluetoothAddress &address)
+{
+    m_settings.beginGroup(QLatin1String("GattCache"));
+    m_settings.remove(key(address));
+    m_settings.endGroup();
+}
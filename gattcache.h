@@ -0,0 +1,62 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef GATTCACHE_H
+#define GATTCACHE_H
+
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+#include <QSettings>
+
+struct GattCacheEntry {
+    QString identity;
+    QBluetoothUuid service;
+    QBluetoothUuid writeCharacteristic;
+    QBluetoothUuid notifyCharacteristic;
+    quint16 writeHandle = 0;
+    quint16 notifyHandle = 0;
+    quint16 notifyDescriptorHandle = 0;     // its Client Characteristic Configuration
+
+    bool isValid() const { return !service.isNull() && !notifyCharacteristic.isNull(); }
+};
+
+/*
+    Remembers, per device address, which service and characteristics were
+    used the last time we talked to it, so a reconnect can go straight to
+    them.  An entry only applies while the device still looks the same
+    (same identity); otherwise, or if a cached handle turns out to be
+    wrong, the session falls back to the full discovery and stores the
+    result again.
+*/
+class GattCache
+{
+public:
+    explicit GattCache(QSettings &settings) : m_settings(settings) { }
+
+    static QString identity(const QBluetoothDeviceInfo &device);
+
+    GattCacheEntry lookup(const QBluetoothAddress &address, const QString &identity);
+    void store(const QBluetoothAddress &address, const GattCacheEntry &entry);
+    void invalidate(const QBluetoothAddress &address);
+
+private:
+    static QString key(const QBluetoothAddress &address) { return QString::number(address.toUInt64(), 16); }
+
+    QSettings &m_settings;
+};
+
+#endif // GATTCACHE_H
@@ -0,0 +1,77 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "historysink.h"
+#include "timeseriesstore.h"
+
+HistorySink::HistorySink(TimeSeriesStore *store, int flushInterval, QObject *parent)
+    : ReadingSink(QLatin1String("history"), parent),
+      m_store(store),
+      m_flushTimer(this)
+{
+    // a flush rewrites every unfinished block, so not too often: the points are in influx too
+    m_flushTimer.setInterval(flushInterval);
+    connect(&m_flushTimer, &QTimer::timeout, this, &HistorySink::flush);
+}
+
+QString HistorySink::seriesName(const QString &measurement, const QString &tagValue, FrameDecoder::Quantity quantity)
+{
+    return measurement + QLatin1Char('/') + tagValue + QLatin1Char('/')
+            + QLatin1String(FrameDecoder::quantityName(quantity));
+}
+
+void HistorySink::open()
+{
+    m_flushTimer.start();
+}
+
+bool HistorySink::write(const Reading &reading)
+{
+    const qint64 ms = reading.timestamp / 1000000;
+    bool ok = true;
+    for (int q = 0; q < FrameDecoder::QuantityCount; ++q) {
+        const FrameDecoder::Quantity quantity = FrameDecoder::Quantity(q);
+        if (!reading.values.has(quantity))
+            continue;
+        // rollup means have more digits than the sensor does, and those don't compress
+        qreal value = reading.values[quantity];
+        const qreal scale = FrameDecoder::resolution(quantity);
+        if (scale > 0)
+            value = qRound64(value * scale) / scale;
+        ok &= m_store->append(seriesName(reading.measurement, reading.tagValue, quantity), ms, value);
+    }
+    if (!ok)
+        emit error(tr("can't store history: %1").arg(m_store->errorString()));
+    return ok;
+}
+
+void HistorySink::flush()
+{
+    if (!m_store->flush())
+        emit error(tr("can't store history: %1").arg(m_store->errorString()));
+}
+
+void HistorySink::close()
+{
+    m_flushTimer.stop();
+    flush();
+}
+
+QString HistorySink::details() const
+{
+    return m_store->statistics();
+}
@@ -0,0 +1,54 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef HISTORYSINK_H
+#define HISTORYSINK_H
+
+#include <QTimer>
+#include "readingsink.h"
+
+class TimeSeriesStore;
+
+/*
+    Keeps every reading in the local TimeSeriesStore, one series per
+    measurement, tag value and quantity (e.g. bodycomp/alice/weight), so
+    that history is available without a database server.
+*/
+class HistorySink : public ReadingSink
+{
+    Q_OBJECT
+
+public:
+    HistorySink(TimeSeriesStore *store, int flushInterval, QObject *parent = nullptr);
+
+    static QString seriesName(const QString &measurement, const QString &tagValue, FrameDecoder::Quantity quantity);
+
+protected:
+    void open() override;
+    bool write(const Reading &reading) override;
+    void close() override;
+    QString details() const override;
+
+private:
+    void flush();
+
+private:
+    TimeSeriesStore *m_store;
+    QTimer m_flushTimer;
+};
+
+#endif // HISTORYSINK_H
@@ -0,0 +1,233 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "historywindow.h"
+#include <QComboBox>
+#include <QDateTime>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QVBoxLayout>
+#include <QWheelEvent>
+#include <cmath>
+
+static const qint64 msPerDay = 24 * 60 * 60 * 1000;
+
+HistoryChart::HistoryChart(const TimeSeriesStore *store, QWidget *parent)
+    : QWidget(parent),
+      m_store(store)
+{
+    setMinimumSize(320, 160);
+    setCursor(Qt::OpenHandCursor);
+}
+
+void HistoryChart::setSeries(const QString &series)
+{
+    m_series = series;
+    refetch();
+}
+
+void HistoryChart::setRange(qint64 from, qint64 to)
+{
+    m_interval = qMax(qint64(1), (to - from) / qMax(1, plotArea().width()));
+    m_first = from / m_interval;
+    refetch();
+}
+
+QRect HistoryChart::plotArea() const
+{
+    const int labelWidth = fontMetrics().width(QLatin1String("0000.0")) + 8;
+    return rect().adjusted(labelWidth, 8, -8, -fontMetrics().height() - 8);
+}
+
+void HistoryChart::refetch()
+{
+    m_buckets = m_store ? m_store->envelope(m_series, m_first * m_interval, m_interval, plotArea().width())
+                        : QVector<TimeSeriesStore::Bucket>(plotArea().width());
+    update();
+    emit rangeChanged(from(), to());
+}
+
+/*!
+    Moves the view \a buckets columns later in time (earlier, if negative),
+    fetching only the columns that come into view.
+*/
+void HistoryChart::scrollBy(qint64 buckets)
+{
+    const int count = m_buckets.count();
+    m_first += buckets;
+    if (!m_store || qAbs(buckets) >= count) {
+        refetch();
+        return;
+    }
+    const int n = int(qAbs(buckets));
+    if (buckets > 0) {
+        m_buckets.remove(0, n);
+        m_buckets += m_store->envelope(m_series, (m_first + count - n) * m_interval, m_interval, n);
+    } else if (buckets < 0) {
+        m_buckets.remove(count - n, n);
+        m_buckets = m_store->envelope(m_series, m_first * m_interval, m_interval, n) + m_buckets;
+    }
+    update();
+    emit rangeChanged(from(), to());
+}
+
+void HistoryChart::resizeEvent(QResizeEvent *)
+{
+    // same scale, more or fewer columns
+    refetch();
+}
+
+void HistoryChart::wheelEvent(QWheelEvent *event)
+{
+    // zoom around the time under the pointer
+    const int x = event->pos().x() - plotArea().left();
+    const qint64 time = (m_first + x) * m_interval;
+    const double factor = std::pow(1.25, -event->angleDelta().y() / 120.0);
+    m_interval = qMax(qint64(1), qint64(m_interval * factor));
+    m_first = time / m_interval - x;
+    refetch();
+}
+
+void HistoryChart::mousePressEvent(QMouseEvent *event)
+{
+    m_dragX = event->pos().x();
+}
+
+void HistoryChart::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!(event->buttons() & Qt::LeftButton))
+        return;
+    // dragging to the right shows earlier times
+    scrollBy(m_dragX - event->pos().x());
+    m_dragX = event->pos().x();
+}
+
+void HistoryChart::paintEvent(QPaintEvent *)
+{
+    QPainter p(this);
+    const QRect area = plotArea();
+    p.fillRect(area, palette().base());
+
+    double min = 0, max = 0;
+    bool any = false;
+    for (const TimeSeriesStore::Bucket &b : m_buckets) {
+        if (!b.count)
+            continue;
+        min = any ? qMin(min, b.min) : b.min;
+        max = any ? qMax(max, b.max) : b.max;
+        any = true;
+    }
+
+    p.setPen(palette().color(QPalette::Text));
+    const QLocale locale;
+    p.drawText(QRect(area.left(), area.bottom() + 4, area.width(), fontMetrics().height()), Qt::AlignLeft,
+               locale.toString(QDateTime::fromMSecsSinceEpoch(from()), QLocale::ShortFormat));
+    p.drawText(QRect(area.left(), area.bottom() + 4, area.width(), fontMetrics().height()), Qt::AlignRight,
+               locale.toString(QDateTime::fromMSecsSinceEpoch(to()), QLocale::ShortFormat));
+    if (!any) {
+        p.drawText(area, Qt::AlignCenter, tr("nothing recorded in this time range"));
+        return;
+    }
+    if (max - min < 1e-9) {
+        min -= 0.5;
+        max += 0.5;
+    }
+    const double margin = (max - min) * 0.05;
+    min -= margin;
+    max += margin;
+    p.drawText(QRect(0, area.top(), area.left() - 4, fontMetrics().height()), Qt::AlignRight,
+               QString::number(max, 'f', 1));
+    p.drawText(QRect(0, area.bottom() - fontMetrics().height(), area.left() - 4, fontMetrics().height()),
+               Qt::AlignRight, QString::number(min, 'f', 1));
+
+    const double scale = area.height() / (max - min);
+    auto y = [&](double v) { return area.bottom() - (v - min) * scale; };
+    QPolygonF line;
+    p.setPen(palette().color(QPalette::Highlight));
+    for (int i = 0; i < m_buckets.count(); ++i) {
+        const TimeSeriesStore::Bucket &b = m_buckets.at(i);
+        if (!b.count)
+            continue;
+        const double x = area.left() + i + 0.5;
+        if (b.max > b.min)
+            p.drawLine(QPointF(x, y(b.min)), QPointF(x, y(b.max)));
+        line << QPointF(x, y((b.min + b.max) / 2));
+    }
+    p.setRenderHint(QPainter::Antialiasing);
+    p.drawPolyline(line);
+}
+
+HistoryWindow::HistoryWindow(const TimeSeriesStore *store, const QString &measurement, const QString &name,
+                             QWidget *parent)
+    : QWidget(parent),
+      m_prefix(measurement + QLatin1Char('/') + name + QLatin1Char('/')),
+      m_quantity(new QComboBox),
+      m_range(new QComboBox),
+      m_chart(new HistoryChart(store)),
+      m_rangeLabel(new QLabel)
+{
+    setWindowTitle(tr("History of %1").arg(name));
+
+    QStringList quantities;
+    if (store)
+        for (const QString &series : store->seriesNames())
+            if (series.startsWith(m_prefix))
+                quantities << series.mid(m_prefix.size());
+    quantities.sort();
+    m_quantity->addItems(quantities);
+    connect(m_quantity, &QComboBox::currentTextChanged, this, [this](const QString &quantity) {
+        m_chart->setSeries(m_prefix + quantity);
+    });
+
+    static const struct { const char *label; int days; } ranges[] = {
+        { QT_TR_NOOP("Last day"), 1 },
+        { QT_TR_NOOP("Last week"), 7 },
+        { QT_TR_NOOP("Last month"), 31 },
+        { QT_TR_NOOP("Last year"), 366 },
+        { QT_TR_NOOP("Last 5 years"), 5 * 366 },
+    };
+    for (const auto &r : ranges)
+        m_range->addItem(tr(r.label), r.days);
+    m_range->setCurrentIndex(2);
+    connect(m_range, QOverload<int>::of(&QComboBox::activated), this, [this](int index) {
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        m_chart->setRange(now - m_range->itemData(index).toInt() * msPerDay, now);
+    });
+    connect(m_chart, &HistoryChart::rangeChanged, this, &HistoryWindow::showRange);
+
+    QHBoxLayout *top = new QHBoxLayout;
+    top->addWidget(m_quantity);
+    top->addWidget(m_range);
+    top->addWidget(m_rangeLabel, 1);
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addLayout(top);
+    layout->addWidget(m_chart, 1);
+    resize(800, 400);
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    m_chart->setSeries(m_prefix + m_quantity->currentText());
+    m_chart->setRange(now - m_range->currentData().toInt() * msPerDay, now);
+}
+
+void HistoryWindow::showRange(qint64 from, qint64 to)
+{
+    const QLocale locale;
+    m_rangeLabel->setText(tr("%1 to %2").arg(locale.toString(QDateTime::fromMSecsSinceEpoch(from), QLocale::ShortFormat))
+                          .arg(locale.toString(QDateTime::fromMSecsSinceEpoch(to), QLocale::ShortFormat)));
+}
@@ -0,0 +1,95 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef HISTORYWINDOW_H
+#define HISTORYWINDOW_H
+
+#include <QVector>
+#include <QWidget>
+#include "timeseriesstore.h"
+
+class QComboBox;
+class QLabel;
+
+/*
+    Draws one series from the history as an envelope: a vertical line from
+    the lowest to the highest value in each column of pixels, joined up.
+    However long the time range, only about as many buckets as there are
+    pixels are fetched (see TimeSeriesStore::envelope()).  Buckets are on a
+    grid aligned to the epoch, so panning only has to fetch the columns
+    that come into view; zooming (with the wheel) fetches them all again.
+*/
+class HistoryChart : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit HistoryChart(const TimeSeriesStore *store, QWidget *parent = nullptr);
+
+    void setSeries(const QString &series);
+    void setRange(qint64 from, qint64 to);
+    qint64 from() const { return m_first * m_interval; }
+    qint64 to() const { return (m_first + m_buckets.count()) * m_interval; }
+
+signals:
+    void rangeChanged(qint64 from, qint64 to);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+
+private:
+    QRect plotArea() const;
+    void refetch();
+    void scrollBy(qint64 buckets);
+
+private:
+    const TimeSeriesStore *m_store;
+    QString m_series;
+    qint64 m_interval = 60000;      // ms per bucket, i.e. per pixel
+    qint64 m_first = 0;             // index of the first bucket, counting from the epoch
+    QVector<TimeSeriesStore::Bucket> m_buckets;
+    int m_dragX = 0;
+};
+
+/*
+    The history of one user (weight and body composition) or one plant
+    (temperature and moisture), with a choice of quantity and time range.
+*/
+class HistoryWindow : public QWidget
+{
+    Q_OBJECT
+
+public:
+    HistoryWindow(const TimeSeriesStore *store, const QString &measurement, const QString &name,
+                  QWidget *parent = nullptr);
+
+private:
+    void showRange(qint64 from, qint64 to);
+
+private:
+    QString m_prefix;       // measurement/name/
+    QComboBox *m_quantity;
+    QComboBox *m_range;
+    HistoryChart *m_chart;
+    QLabel *m_rangeLabel;
+};
+
+#endif // HISTORYWINDOW_H
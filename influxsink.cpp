@@ -0,0 +1,198 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "influxsink.h"
+#include "influxwriter.h"
+#include <QDebug>
+#include <QSettings>
+#include <QUrlQuery>
+
+InfluxSink::InfluxSink(const WriterOptions &options, QObject *parent)
+    : ReadingSink(QLatin1String("influx"), parent),
+      m_options(options)
+{
+}
+
+/*!
+    Reads endpoints and routes from the Influx group of \a settings, e.g.
+
+    \code
+    [Influx]
+    endpoints=health, weather
+    health\url=https://health.example.com:8086
+    health\authorization=Token abc123
+    weather\database=weather
+    weather\retentionPolicy=oneyear
+    routes=type:scale=health, user:guest=weather, measurement:plants=weather
+    default=health
+    \endcode
+
+    Without any of that, body composition goes to the health database and
+    plant readings to the weather database, on localhost.
+*/
+void InfluxSink::configure(QSettings &settings)
+{
+    settings.beginGroup(QLatin1String("Influx"));
+    const QStringList endpoints = settings.value(QLatin1String("endpoints"),
+            QStringList() << QLatin1String("health") << QLatin1String("weather")).toStringList();
+    for (const QString &name : endpoints) {
+        Endpoint endpoint;
+        endpoint.name = name;
+        settings.beginGroup(name);
+        endpoint.url = QUrl(settings.value(QLatin1String("url"), QLatin1String("http://localhost:8086")).toString());
+        endpoint.database = settings.value(QLatin1String("database"), name).toString();
+        endpoint.retentionPolicy = settings.value(QLatin1String("retentionPolicy")).toString();
+        endpoint.authorization = settings.value(QLatin1String("authorization")).toString().toUtf8();
+        endpoint.maxInFlight = settings.value(QLatin1String("maxInFlight"), 0).toInt();
+        settings.endGroup();
+        addEndpoint(endpoint);
+    }
+
+    static const struct { const char *name; Route::Key key; } keys[] = {
+        { "type", Route::DeviceType },
+        { "measurement", Route::Measurement },
+        { "user", Route::User },
+        { "device", Route::Device },
+    };
+    const QStringList routes = settings.value(QLatin1String("routes"),
+            QStringList() << QLatin1String("measurement:bodycomp=health")
+                          << QLatin1String("measurement:plants=weather")).toStringList();
+    for (const QString &r : routes) {
+        // key:value=endpoint; device addresses have colons too, so split at the first and the last
+        const int colon = r.indexOf(QLatin1Char(':'));
+        const int equals = r.lastIndexOf(QLatin1Char('='));
+        bool ok = false;
+        Route route;
+        if (colon > 0 && equals > colon) {
+            const QString key = r.left(colon).trimmed();
+            for (const auto &k : keys) {
+                if (key == QLatin1String(k.name)) {
+                    route.key = k.key;
+                    ok = true;
+                }
+            }
+            route.value = r.mid(colon + 1, equals - colon - 1).trimmed();
+            route.endpoint = r.mid(equals + 1).trimmed();
+        }
+        if (!ok || !endpoints.contains(route.endpoint)) {
+            qWarning() << "ignoring influx route" << r;
+            continue;
+        }
+        addRoute(route);
+    }
+    setDefaultEndpoint(settings.value(QLatin1String("default")).toString());
+    settings.endGroup();
+}
+
+void InfluxSink::addEndpoint(const Endpoint &endpoint)
+{
+    m_endpoints.append(endpoint);
+}
+
+QUrl InfluxSink::writeUrl(const Endpoint &endpoint)
+{
+    QUrl ret = endpoint.url;
+    QString path = ret.path();
+    if (!path.endsWith(QLatin1Char('/')))
+        path += QLatin1Char('/');
+    ret.setPath(path + QLatin1String("write"));
+    QUrlQuery query;
+    query.addQueryItem(QLatin1String("db"), endpoint.database);
+    if (!endpoint.retentionPolicy.isEmpty())
+        query.addQueryItem(QLatin1String("rp"), endpoint.retentionPolicy);
+    ret.setQuery(query);
+    return ret;
+}
+
+QString InfluxSink::route(const Reading &reading) const
+{
+    for (const Route &route : m_routes) {
+        bool match = false;
+        switch (route.key) {
+        case Route::DeviceType:
+            match = reading.deviceType == route.value;
+            break;
+        case Route::Measurement:
+            // plants also covers its rollups, plants_15m etc.
+            match = reading.measurement == route.value
+                    || (reading.window && reading.measurement.size() > route.value.size()
+                        && reading.measurement.startsWith(route.value)
+                        && reading.measurement.at(route.value.size()) == QLatin1Char('_'));
+            break;
+        case Route::User:
+            match = reading.tagKey == QLatin1String("username") && reading.tagValue == route.value;
+            break;
+        case Route::Device:
+            match = reading.device.compare(route.value, Qt::CaseInsensitive) == 0;
+            break;
+        }
+        if (match)
+            return route.endpoint;
+    }
+    return m_defaultEndpoint;
+}
+
+void InfluxSink::open()
+{
+    for (const Endpoint &endpoint : m_endpoints) {
+        InfluxWriter *writer = new InfluxWriter(writeUrl(endpoint), this);
+        writer->setMaxQueueLines(m_options.maxQueueLines);
+        writer->setMaxBatchLines(m_options.maxBatchLines);
+        writer->setFlushInterval(m_options.flushInterval);
+        writer->setMaxInFlight(endpoint.maxInFlight > 0 ? endpoint.maxInFlight : m_options.maxInFlight);
+        if (!endpoint.authorization.isEmpty())
+            writer->setAuthorization(endpoint.authorization);
+        connect(writer, &InfluxWriter::error, this, [this, endpoint](const QString &message) {
+            emit error(endpoint.name + QLatin1String(": ") + message);
+        });
+        connect(writer, &InfluxWriter::delivered, this, &InfluxSink::stored);
+        // keep readings on disk until the database has them
+        if (!m_options.spoolDirectory.isEmpty())
+            writer->setSpool(m_options.spoolDirectory + QLatin1Char('/') + endpoint.name);
+        m_writers.insert(endpoint.name, writer);
+    }
+}
+
+bool InfluxSink::write(const Reading &reading)
+{
+    InfluxWriter *writer = m_writers.value(route(reading));
+    if (!writer) {
+        qWarning() << "no influx endpoint for" << reading.measurement << reading.tagValue;
+        return false;
+    }
+    m_encoder.clear();
+    m_encoder.append(reading);
+    // the writer keeps its own copy; the encoder's buffer stays with us for next time
+    writer->write(QByteArray(m_encoder.constData(), m_encoder.size()), reading.device);
+    return true;
+}
+
+void InfluxSink::close()
+{
+    // whatever doesn't make it out now stays in the spool for next time
+    for (InfluxWriter *writer : m_writers)
+        writer->flush();
+}
+
+QString InfluxSink::details() const
+{
+    QStringList ret;
+    for (const Endpoint &endpoint : m_endpoints)
+        if (const InfluxWriter *writer = m_writers.value(endpoint.name))
+            ret << endpoint.name + QLatin1String(": ") + writer->statistics();
+    return ret.join(QLatin1String("\n    "));
+}
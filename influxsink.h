@@ -0,0 +1,96 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef INFLUXSINK_H
+#define INFLUXSINK_H
+
+#include <QHash>
+#include <QUrl>
+#include <QVector>
+#include "lineprotocol.h"
+#include "readingsink.h"
+
+class InfluxWriter;
+class QSettings;
+
+/*
+    Stores readings in InfluxDB.  Each reading is routed to an endpoint
+    (a server and database, with its own credentials) by the first route
+    that matches its device type, measurement, user or device; every
+    endpoint has an InfluxWriter of its own, with its own queue, spool and
+    limit on requests in flight, so one that is slow or down only holds up
+    its own readings.  The writers are created on the sink's thread, so
+    all the network traffic happens there.
+*/
+class InfluxSink : public ReadingSink
+{
+    Q_OBJECT
+
+public:
+    struct WriterOptions {
+        int maxQueueLines = 10000;
+        int maxBatchLines = 500;
+        int flushInterval = 1000;
+        int maxInFlight = 2;
+        QString spoolDirectory; // empty: don't spool
+    };
+
+    struct Endpoint {
+        QString name;
+        QUrl url;                   // of the server, e.g. http://localhost:8086
+        QString database;
+        QString retentionPolicy;    // empty: the database's default
+        QByteArray authorization;   // value of the Authorization header, if any
+        int maxInFlight = 0;        // 0: as in WriterOptions
+    };
+
+    struct Route {
+        enum Key { DeviceType, Measurement, User, Device };
+        Key key;
+        QString value;
+        QString endpoint;
+    };
+
+    explicit InfluxSink(const WriterOptions &options, QObject *parent = nullptr);
+
+    void configure(QSettings &settings);
+    void addEndpoint(const Endpoint &endpoint);
+    void addRoute(const Route &route) { m_routes.append(route); }
+    void setDefaultEndpoint(const QString &name) { m_defaultEndpoint = name; }
+    QString route(const Reading &reading) const;
+
+    static QUrl writeUrl(const Endpoint &endpoint);
+
+signals:
+    void stored(const QStringList &devices);
+
+protected:
+    void open() override;
+    bool write(const Reading &reading) override;
+    void close() override;
+    QString details() const override;
+
+private:
+    WriterOptions m_options;
+    LineProtocolEncoder m_encoder;
+    QVector<Endpoint> m_endpoints;
+    QVector<Route> m_routes;
+    QString m_defaultEndpoint;
+    QHash<QString, InfluxWriter *> m_writers;   // by endpoint name
+};
+
+#endif // INFLUXSINK_H
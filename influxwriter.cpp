@@ -0,0 +1,221 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "influxwriter.h"
+#include "spool.h"
+#include <QDebug>
+#include <QMetaEnum>
+
+static const int initialBackoffMs = 1000;
+static const int maxBackoffMs = 5 * 60 * 1000;
+
+InfluxWriter::InfluxWriter(const QUrl &url, QObject *parent)
+    : QObject(parent),
+      m_url(url),
+      m_request(url)
+{
+    m_request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(1000);
+    connect(&m_flushTimer, &QTimer::timeout, this, &InfluxWriter::flush);
+    m_backoffTimer.setSingleShot(true);
+    connect(&m_backoffTimer, &QTimer::timeout, this, &InfluxWriter::flush);
+}
+
+InfluxWriter::~InfluxWriter()
+{
+}
+
+/*!
+    Spools lines to files in \a directory, and starts replaying whatever
+    was left there last time.  Returns false (and keeps queueing in memory)
+    if the directory can't be used.
+*/
+bool InfluxWriter::setSpool(const QString &directory)
+{
+    QScopedPointer<Spool> spool(new Spool(directory));
+    if (!spool->open()) {
+        emit error(tr("can't spool to %1: %2").arg(directory).arg(spool->errorString()));
+        return false;
+    }
+    m_spool.swap(spool);
+    fillFromSpool();
+    return true;
+}
+
+void InfluxWriter::write(const QByteArray &line, const QString &source)
+{
+    if (m_spool) {
+        if (m_spool->append(line)) {
+            m_spooledSources.enqueue(source);
+            fillFromSpool();
+            return;
+        }
+        // keep going in memory rather than lose everything
+        emit error(tr("spool write failed, no longer spooling: %1").arg(m_spool->errorString()));
+        m_spool.reset();
+        m_spooledSources.clear();
+    }
+    enqueue(Line { line, source, 0 });
+}
+
+void InfluxWriter::enqueue(const Line &line)
+{
+    if (m_queuedLines >= m_maxQueueLines) {
+        if (m_queue.isEmpty()) {
+            ++m_dropped; // everything queued is waiting for a retry; keep that
+            return;
+        }
+        m_queue.dequeue(); // make room by dropping the oldest
+        --m_queuedLines;
+        ++m_dropped;
+    }
+    m_queue.enqueue(line);
+    ++m_queuedLines;
+
+    if (m_queue.count() >= m_maxBatchLines)
+        sendBatches();
+    else if (!m_flushTimer.isActive())
+        m_flushTimer.start();
+}
+
+/*!
+    Moves lines from the spool to the queue, but no more than the next few
+    batches need; the rest follow as batches are delivered, so that
+    replaying a large backlog doesn't hold up the event loop.
+*/
+void InfluxWriter::fillFromSpool()
+{
+    if (!m_spool)
+        return;
+    const int window = qMin(m_maxQueueLines, m_maxBatchLines * (m_maxInFlight + 1));
+    Line line;
+    while (m_queuedLines < window && m_spool->readNext(&line.line, &line.segment)) {
+        // lines left over from an earlier run don't have a source any more
+        line.source = line.segment >= m_spool->firstSegmentOfThisRun() && !m_spooledSources.isEmpty()
+                ? m_spooledSources.dequeue() : QString();
+        enqueue(line);
+    }
+}
+
+void InfluxWriter::acknowledge(const Batch &batch)
+{
+    if (!m_spool)
+        return;
+    for (const auto &segment : batch.segments)
+        m_spool->acknowledge(segment.first, segment.second);
+    fillFromSpool();
+}
+
+void InfluxWriter::flush()
+{
+    m_flushTimer.stop();
+    sendBatches();
+}
+
+InfluxWriter::Batch InfluxWriter::takeBatch()
+{
+    Batch batch;
+    if (!m_retryQueue.isEmpty()) {
+        batch = m_retryQueue.dequeue();
+    } else {
+        while (!m_queue.isEmpty() && batch.lines < m_maxBatchLines) {
+            const Line line = m_queue.dequeue();
+            if (batch.lines)
+                batch.body.append('\n');
+            batch.body.append(line.line);
+            if (!line.source.isEmpty())
+                batch.sources << line.source;
+            if (m_spool) {
+                if (batch.segments.isEmpty() || batch.segments.last().first != line.segment)
+                    batch.segments.append(qMakePair(line.segment, 0));
+                ++batch.segments.last().second;
+            }
+            ++batch.lines;
+        }
+    }
+    m_queuedLines -= batch.lines;
+    return batch;
+}
+
+void InfluxWriter::sendBatches()
+{
+    // what goes out should be safely spooled first, in case it doesn't arrive
+    if (m_spool && !m_spool->sync())
+        emit error(tr("spool sync failed: %1").arg(m_spool->errorString()));
+    if (m_backoffTimer.isActive())
+        return; // the server is having trouble; wait until it's time to retry
+    while (m_inFlight.count() < m_maxInFlight && (!m_retryQueue.isEmpty() || !m_queue.isEmpty())) {
+        Batch batch = takeBatch();
+        m_lastBatchSize = batch.lines;
+        QNetworkReply *reply = m_nam.post(m_request, batch.body);
+        m_inFlight.insert(reply, batch);
+        connect(reply, &QNetworkReply::finished, this, &InfluxWriter::replyFinished);
+    }
+}
+
+void InfluxWriter::replyFinished()
+{
+    QNetworkReply *reply = static_cast<QNetworkReply *>(sender());
+    Batch batch = m_inFlight.take(reply);
+    reply->deleteLater();
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    if (reply->error() == QNetworkReply::NoError) {
+        qDebug() << "influxDB says: " << status << reply->readAll();
+        m_backoffMs = 0;
+        m_delivered += batch.lines;
+        if (!batch.sources.isEmpty())
+            emit delivered(batch.sources);
+        acknowledge(batch);
+        sendBatches();
+    } else if (status >= 400 && status < 500 && status != 408 && status != 429) {
+        // the request itself is wrong: sending it again won't help
+        m_dropped += batch.lines;
+        emit error(tr("InfluxDB rejected %1 lines: %2").arg(batch.lines).arg(QString::fromUtf8(reply->readAll())));
+        acknowledge(batch);
+        sendBatches();
+    } else {
+        static QMetaEnum menum = reply->metaObject()->enumerator(
+                    reply->metaObject()->indexOfEnumerator("NetworkError"));
+        // the same batch failing again and again is an outage, not a glitch
+        emit error(tr("network error: %1 (%2 lines, attempt %3)").arg(QLatin1String(menum.valueToKey(reply->error())))
+                   .arg(batch.lines).arg(batch.attempts + 1));
+        retry(batch);
+    }
+}
+
+void InfluxWriter::retry(Batch batch)
+{
+    ++batch.attempts;
+    ++m_retries;
+    m_queuedLines += batch.lines;
+    m_retryQueue.prepend(batch);
+    m_backoffMs = m_backoffMs ? qMin(m_backoffMs * 2, maxBackoffMs) : initialBackoffMs;
+    if (!m_backoffTimer.isActive())
+        m_backoffTimer.start(m_backoffMs);
+}
+
+QString InfluxWriter::statistics() const
+{
+    QString ret = tr("%1: %2 queued, %3 in flight, last batch %4 lines, %5 delivered, %6 dropped, %7 retries")
+            .arg(m_url.toString()).arg(m_queuedLines).arg(m_inFlight.count()).arg(m_lastBatchSize)
+            .arg(m_delivered).arg(m_dropped).arg(m_retries);
+    if (m_spool)
+        ret += tr(", %1 bytes spooled in %2 segments").arg(m_spool->backlogBytes()).arg(m_spool->segmentCount());
+    return ret;
+}
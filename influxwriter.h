@@ -0,0 +1,126 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef INFLUXWRITER_H
+#define INFLUXWRITER_H
+
+#include <QHash>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QQueue>
+#include <QScopedPointer>
+#include <QTimer>
+#include <QVector>
+
+class Spool;
+
+/*
+    Sends line protocol to one InfluxDB write endpoint.  Lines are queued
+    and sent in batches, one POST per batch, when enough have accumulated
+    or the flush interval has passed.  Several requests may be in flight;
+    a batch that fails because the server is unreachable or overloaded is
+    retried with exponential backoff.  Lines are only dropped if the queue
+    overflows or the server rejects them as malformed.
+
+    With a spool, every line is appended to it before anything else, and
+    only a window of it is kept in memory; lines are acknowledged to the
+    spool once the server has accepted them, so nothing is lost while the
+    server is down, or if we crash, and nothing is dropped for lack of
+    queue space.
+*/
+class InfluxWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InfluxWriter(const QUrl &url, QObject *parent = nullptr);
+    ~InfluxWriter();
+
+    bool setSpool(const QString &directory);
+
+    void setMaxQueueLines(int lines) { m_maxQueueLines = lines; }
+    void setMaxBatchLines(int lines) { m_maxBatchLines = lines; }
+    void setFlushInterval(int ms) { m_flushTimer.setInterval(ms); }
+    void setMaxInFlight(int requests) { m_maxInFlight = requests; }
+    void setAuthorization(const QByteArray &value) { m_request.setRawHeader("Authorization", value); }
+
+    void write(const QByteArray &line, const QString &source = QString());
+
+    int queueDepth() const { return m_queuedLines; }
+    int inFlight() const { return m_inFlight.count(); }
+    int lastBatchSize() const { return m_lastBatchSize; }
+    quint64 deliveredCount() const { return m_delivered; }
+    quint64 droppedCount() const { return m_dropped; }
+    quint64 retryCount() const { return m_retries; }
+    QString statistics() const;
+
+public slots:
+    void flush();
+
+signals:
+    void error(QString message);
+    void delivered(const QStringList &sources);
+
+private slots:
+    void replyFinished();
+
+private:
+    struct Line {
+        QByteArray line;
+        QString source;     // device it came from, if anyone wants to know when it's stored
+        quint32 segment;    // in the spool
+    };
+    struct Batch {
+        QByteArray body;
+        QStringList sources;
+        QVector<QPair<quint32, int>> segments; // spool segment, line count
+        int lines = 0;
+        int attempts = 0;   // failed sends so far
+    };
+
+    void enqueue(const Line &line);
+    void fillFromSpool();
+    void acknowledge(const Batch &batch);
+    void sendBatches();
+    Batch takeBatch();
+    void retry(Batch batch);
+
+private:
+    QUrl m_url;
+    QNetworkAccessManager m_nam;
+    QNetworkRequest m_request;
+    QQueue<Line> m_queue;
+    QQueue<Batch> m_retryQueue;
+    QHash<QNetworkReply *, Batch> m_inFlight;
+    QScopedPointer<Spool> m_spool;
+    QQueue<QString> m_spooledSources; // of lines appended since we started, in the same order
+    QTimer m_flushTimer;
+    QTimer m_backoffTimer;
+
+    int m_maxQueueLines = 10000;
+    int m_maxBatchLines = 500;
+    int m_maxInFlight = 2;
+    int m_backoffMs = 0;
+    int m_queuedLines = 0;  // in m_queue and m_retryQueue
+    int m_lastBatchSize = 0;
+    quint64 m_delivered = 0;
+    quint64 m_dropped = 0;
+    quint64 m_retries = 0;
+};
+
+#endif // INFLUXWRITER_H
@@ -0,0 +1,141 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "latencytracker.h"
+#include <QFile>
+#include <QTextStream>
+#include <QtAlgorithms>
+
+int LatencyHistogram::bucket(qint64 us)
+{
+    if (us < 4)
+        return int(qMax(qint64(0), us));
+    const int msb = 63 - qCountLeadingZeroBits(quint64(us));
+    const int sub = int(us >> (msb - 2)) & 3;
+    return qMin(int(BucketCount) - 1, (msb - 1) * 4 + sub);
+}
+
+qint64 LatencyHistogram::bucketStart(int bucket)
+{
+    if (bucket < 4)
+        return bucket;
+    const int msb = bucket / 4 + 1;
+    return qint64(4 + bucket % 4) << (msb - 2);
+}
+
+void LatencyHistogram::add(qint64 us)
+{
+    ++m_buckets[bucket(us)];
+    if (!m_count || us < m_min)
+        m_min = us;
+    if (!m_count || us > m_max)
+        m_max = us;
+    ++m_count;
+}
+
+/*!
+    Returns the approximate value below which \a p (0..1) of the samples fall:
+    the middle of the bucket where the cumulative count crosses it.
+*/
+qint64 LatencyHistogram::percentile(qreal p) const
+{
+    if (!m_count)
+        return 0;
+    const quint64 rank = qMax(quint64(1), quint64(p * m_count + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_buckets[i];
+        if (seen >= rank) {
+            const qint64 mid = (bucketStart(i) + bucketStart(i + 1)) / 2;
+            return qBound(m_min, mid, m_max);
+        }
+    }
+    return m_max;
+}
+
+const char *LatencyTracker::phaseName(Phase phase)
+{
+    static const char *names[PhaseCount] = {
+        "advertised", "connect requested", "connected", "service found", "services done",
+        "details discovered", "request sent", "first reading", "stored"
+    };
+    return phase < PhaseCount ? names[phase] : "";
+}
+
+void LatencyTracker::mark(const QString &device, Phase phase)
+{
+    const qint64 now = m_clock.nsecsElapsed() / 1000;
+    auto it = m_timelines.find(device);
+    if (phase == Advertised || it == m_timelines.end()) {
+        it = m_timelines.insert(device, Timeline());
+        for (qint64 &t : it->at)
+            t = -1;
+    }
+    Timeline &timeline = *it;
+    if (timeline.at[phase] >= 0 && phase != Stored)
+        return; // only the first occurrence of each phase per connection counts
+
+    for (int previous = phase - 1; previous >= 0; --previous) {
+        if (timeline.at[previous] >= 0) {
+            m_phases[phase].add(now - timeline.at[previous]);
+            break;
+        }
+    }
+    timeline.at[phase] = now;
+
+    if (timeline.at[Advertised] >= 0) {
+        if (phase == FirstReading)
+            m_firstReading.add(now - timeline.at[Advertised]);
+        else if (phase == Stored)
+            m_stored.add(now - timeline.at[Advertised]);
+    }
+}
+
+static QString histogramLine(const QString &label, const LatencyHistogram &h)
+{
+    return QStringLiteral("%1\t%2\t%3\t%4\t%5\t%6\n").arg(label, -22).arg(h.count())
+            .arg(h.percentile(0.5) / 1000.0, 0, 'f', 1)
+            .arg(h.percentile(0.95) / 1000.0, 0, 'f', 1)
+            .arg(h.percentile(0.99) / 1000.0, 0, 'f', 1)
+            .arg(h.max() / 1000.0, 0, 'f', 1);
+}
+
+/*!
+    Returns a table of per-phase latencies in milliseconds.
+*/
+QString LatencyTracker::summary() const
+{
+    QString ret = QStringLiteral("%1\tcount\tp50\tp95\tp99\tmax (ms)\n").arg(QStringLiteral("phase"), -22);
+    for (int p = ConnectRequested; p < PhaseCount; ++p)
+        if (m_phases[p].count())
+            ret += histogramLine(QLatin1String(phaseName(Phase(p))), m_phases[p]);
+    if (m_firstReading.count())
+        ret += histogramLine(QStringLiteral("advert to reading"), m_firstReading);
+    if (m_stored.count())
+        ret += histogramLine(QStringLiteral("advert to stored"), m_stored);
+    return ret;
+}
+
+bool LatencyTracker::dump(const QString &fileName) const
+{
+    QFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+    QTextStream out(&f);
+    out << summary();
+    return true;
+}
@@ -0,0 +1,92 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef LATENCYTRACKER_H
+#define LATENCYTRACKER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QString>
+
+/*
+    A histogram of durations in microseconds with logarithmic buckets:
+    four per power of two, so any percentile is within about 12% of the
+    true value, in a fixed amount of memory.
+*/
+class LatencyHistogram
+{
+public:
+    void add(qint64 us);
+    quint64 count() const { return m_count; }
+    qint64 min() const { return m_min; }
+    qint64 max() const { return m_max; }
+    qint64 percentile(qreal p) const;
+
+private:
+    static int bucket(qint64 us);
+    static qint64 bucketStart(int bucket);
+
+    enum { BucketCount = 4 * 48 };
+    quint32 m_buckets[BucketCount] = {};
+    quint64 m_count = 0;
+    qint64 m_min = 0;
+    qint64 m_max = 0;
+};
+
+/*
+    Timestamps the phases of each device's connection on a monotonic clock,
+    from the advert that made us connect to the reading being stored, and
+    keeps a histogram of the time spent getting to each phase from the one
+    before it.
+*/
+class LatencyTracker
+{
+public:
+    enum Phase {
+        Advertised,         // advert seen; about to ask for a connection
+        ConnectRequested,   // session created (possibly after waiting for a free slot)
+        Connected,
+        ServiceFound,       // the service we need was announced
+        ServicesDone,       // service discovery finished
+        DetailsDiscovered,  // characteristics known
+        RequestSent,        // user profile written, notifications enabled
+        FirstReading,
+        Stored,             // the database accepted the reading
+        PhaseCount
+    };
+
+    LatencyTracker() { m_clock.start(); }
+
+    void mark(const QString &device, Phase phase);
+    QString summary() const;
+    bool dump(const QString &fileName) const;
+
+    static const char *phaseName(Phase phase);
+
+private:
+    struct Timeline {
+        qint64 at[PhaseCount];
+    };
+
+    QElapsedTimer m_clock;
+    QHash<QString, Timeline> m_timelines;
+    LatencyHistogram m_phases[PhaseCount];  // from the previous marked phase
+    LatencyHistogram m_firstReading;        // from Advertised
+    LatencyHistogram m_stored;              // from Advertised
+};
+
+#endif // LATENCYTRACKER_H
@@ -0,0 +1,229 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "lineprotocol.h"
+#include <cmath>
+
+// decimal places kept when formatting fractions; sensors don't get near this
+static const int fractionDigits = 6;
+static const double fractionScale = 1e6;
+
+LineProtocolEncoder::LineProtocolEncoder(int reserve)
+{
+    m_buffer.reserve(reserve);
+}
+
+static inline bool needsEscape(uint c, int context)
+{
+    switch (context) {
+    case 0: // measurement
+        return c == ',' || c == ' ';
+    case 1: // tag key, tag value, field key
+        return c == ',' || c == '=' || c == ' ';
+    default: // string field value
+        return c == '"' || c == '\\';
+    }
+}
+
+void LineProtocolEncoder::appendEscaped(QLatin1String s, Context context)
+{
+    for (int i = 0; i < s.size(); ++i) {
+        const char c = s.data()[i];
+        if (needsEscape(uchar(c), context))
+            m_buffer.append('\\');
+        m_buffer.append(c);
+    }
+}
+
+void LineProtocolEncoder::appendEscaped(const QString &s, Context context)
+{
+    // UTF-8 by hand, to avoid a temporary QByteArray
+    const QChar *p = s.constData();
+    const QChar *end = p + s.size();
+    for (; p < end; ++p) {
+        uint c = p->unicode();
+        if (c < 0x80) {
+            if (c == '\n' || c == '\r')
+                c = ' '; // newlines end the line; nothing can escape them
+            if (needsEscape(c, context))
+                m_buffer.append('\\');
+            m_buffer.append(char(c));
+            continue;
+        }
+        if (p->isHighSurrogate() && p + 1 < end && (p + 1)->isLowSurrogate()) {
+            c = QChar::surrogateToUcs4(*p, *(p + 1));
+            ++p;
+        } else if (p->isSurrogate()) {
+            c = QChar::ReplacementCharacter;
+        }
+        if (c < 0x800) {
+            m_buffer.append(char(0xc0 | (c >> 6)));
+        } else if (c < 0x10000) {
+            m_buffer.append(char(0xe0 | (c >> 12)));
+            m_buffer.append(char(0x80 | ((c >> 6) & 0x3f)));
+        } else {
+            m_buffer.append(char(0xf0 | (c >> 18)));
+            m_buffer.append(char(0x80 | ((c >> 12) & 0x3f)));
+            m_buffer.append(char(0x80 | ((c >> 6) & 0x3f)));
+        }
+        m_buffer.append(char(0x80 | (c & 0x3f)));
+    }
+}
+
+void LineProtocolEncoder::appendInteger(qint64 value)
+{
+    char digits[20];
+    int n = 0;
+    quint64 v = value < 0 ? 0 - quint64(value) : quint64(value);
+    do {
+        digits[n++] = char('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (value < 0)
+        m_buffer.append('-');
+    while (n)
+        m_buffer.append(digits[--n]);
+}
+
+void LineProtocolEncoder::appendNumber(double value)
+{
+    if (!std::isfinite(value)) {
+        m_buffer.append('0'); // influx has no way to say NaN
+        return;
+    }
+    const double scaled = std::round(std::fabs(value) * fractionScale);
+    if (scaled >= 9e18) { // too big for fixed point; not a sensor reading anyway
+        m_buffer.append(QByteArray::number(value, 'g', 17));
+        return;
+    }
+    const quint64 fixed = quint64(scaled);
+    const quint64 whole = fixed / quint64(fractionScale);
+    quint64 fraction = fixed % quint64(fractionScale);
+    if (value < 0 && fixed)
+        m_buffer.append('-');
+    appendInteger(qint64(whole));
+    if (!fraction)
+        return;
+    int digits = fractionDigits;
+    while (fraction % 10 == 0) {
+        fraction /= 10;
+        --digits;
+    }
+    m_buffer.append('.');
+    char buf[fractionDigits];
+    for (int i = digits - 1; i >= 0; --i) {
+        buf[i] = char('0' + fraction % 10);
+        fraction /= 10;
+    }
+    m_buffer.append(buf, digits);
+}
+
+void LineProtocolEncoder::beginLine(QLatin1String measurement)
+{
+    if (!m_buffer.isEmpty())
+        m_buffer.append('\n');
+    appendEscaped(measurement, Measurement);
+    m_firstField = true;
+}
+
+void LineProtocolEncoder::beginLine(const QString &measurement)
+{
+    if (!m_buffer.isEmpty())
+        m_buffer.append('\n');
+    appendEscaped(measurement, Measurement);
+    m_firstField = true;
+}
+
+void LineProtocolEncoder::addTag(QLatin1String key, const QString &value)
+{
+    if (value.isEmpty())
+        return; // empty tag values aren't allowed
+    m_buffer.append(',');
+    appendEscaped(key, TagOrFieldKey);
+    m_buffer.append('=');
+    appendEscaped(value, TagOrFieldKey);
+}
+
+void LineProtocolEncoder::addTag(const QString &key, const QString &value)
+{
+    if (key.isEmpty() || value.isEmpty())
+        return;
+    m_buffer.append(',');
+    appendEscaped(key, TagOrFieldKey);
+    m_buffer.append('=');
+    appendEscaped(value, TagOrFieldKey);
+}
+
+void LineProtocolEncoder::addField(QLatin1String key, double value)
+{
+    m_buffer.append(m_firstField ? ' ' : ',');
+    m_firstField = false;
+    appendEscaped(key, TagOrFieldKey);
+    m_buffer.append('=');
+    appendNumber(value);
+}
+
+void LineProtocolEncoder::addField(QLatin1String key, QLatin1String suffix, double value)
+{
+    m_buffer.append(m_firstField ? ' ' : ',');
+    m_firstField = false;
+    appendEscaped(key, TagOrFieldKey);
+    appendEscaped(suffix, TagOrFieldKey);
+    m_buffer.append('=');
+    appendNumber(value);
+}
+
+void LineProtocolEncoder::addField(QLatin1String key, const QString &value)
+{
+    m_buffer.append(m_firstField ? ' ' : ',');
+    m_firstField = false;
+    appendEscaped(key, TagOrFieldKey);
+    m_buffer.append("=\"", 2);
+    appendEscaped(value, StringValue);
+    m_buffer.append('"');
+}
+
+void LineProtocolEncoder::endLine(qint64 timestamp)
+{
+    if (timestamp <= 0)
+        return;
+    m_buffer.append(' ');
+    appendInteger(timestamp);
+}
+
+void LineProtocolEncoder::append(const Reading &reading)
+{
+    beginLine(reading.measurement);
+    addTag(reading.tagKey, reading.tagValue);
+    for (int q = 0; q < FrameDecoder::QuantityCount; ++q) {
+        const FrameDecoder::Quantity quantity = FrameDecoder::Quantity(q);
+        if (!reading.values.has(quantity))
+            continue;
+        const QLatin1String name(FrameDecoder::quantityName(quantity));
+        addField(name, reading.values[quantity]);
+        if (reading.window) {
+            addField(name, QLatin1String("_min"), reading.min[quantity]);
+            addField(name, QLatin1String("_max"), reading.max[quantity]);
+            addField(name, QLatin1String("_last"), reading.last[quantity]);
+        }
+        if (quantity == FrameDecoder::Weight)
+            addField(QLatin1String("unit"), QStringLiteral("kg"));
+    }
+    if (reading.window)
+        addField(QLatin1String("count"), double(reading.count));
+    endLine(reading.timestamp);
+}
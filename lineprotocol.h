@@ -0,0 +1,67 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef LINEPROTOCOL_H
+#define LINEPROTOCOL_H
+
+#include <QByteArray>
+#include <QString>
+#include "reading.h"
+
+/*
+    Builds InfluxDB line protocol in a buffer that is reserved once and
+    reused: names and values are escaped and numbers are formatted
+    straight into it, so encoding a line doesn't allocate unless the
+    buffer has to grow.
+
+    Numbers are always written as floats (no i suffix), because that's
+    what the databases we write to already have for every field.
+*/
+class LineProtocolEncoder
+{
+public:
+    explicit LineProtocolEncoder(int reserve = 512);
+
+    void clear() { m_buffer.resize(0); }
+    const QByteArray &data() const { return m_buffer; }
+    int size() const { return m_buffer.size(); }
+    const char *constData() const { return m_buffer.constData(); }
+
+    void beginLine(QLatin1String measurement);
+    void beginLine(const QString &measurement);
+    void addTag(QLatin1String key, const QString &value);
+    void addTag(const QString &key, const QString &value);
+    void addField(QLatin1String key, double value);
+    void addField(QLatin1String key, QLatin1String suffix, double value);
+    void addField(QLatin1String key, const QString &value);
+    void endLine(qint64 timestamp);  // nanoseconds; 0 to let the server decide
+
+    void append(const Reading &reading);
+
+private:
+    enum Context { Measurement, TagOrFieldKey, StringValue };
+    void appendEscaped(QLatin1String s, Context context);
+    void appendEscaped(const QString &s, Context context);
+    void appendNumber(double value);
+    void appendInteger(qint64 value);
+
+private:
+    QByteArray m_buffer;
+    bool m_firstField = true;
+};
+
+#endif // LINEPROTOCOL_H
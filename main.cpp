@@ -16,42 +16,105 @@
 ****************************************************************************/
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QElapsedTimer>
 #include <QMenu>
 #include <QMessageBox>
 #include <QSystemTrayIcon>
+#include "btsnoopreplay.h"
+#include "resourceusage.h"
+#include "statuspresenter.h"
 #include "trayicon.h"
 #include "trayble.h"
 
 int main(int argc, char *argv[])
 {
+    QElapsedTimer startup;
+    startup.start();
     QApplication app(argc, argv);
     app.setOrganizationDomain(QLatin1String("ecloud.org"));
     app.setApplicationName(QLatin1String("TrayBLE"));
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption replayOption(QLatin1String("replay"),
+            QApplication::translate("main", "Replay a btsnoop capture instead of using the Bluetooth adapter."),
+            QLatin1String("file"));
+    parser.addOption(replayOption);
+    QCommandLineOption fastOption(QLatin1String("fast"),
+            QApplication::translate("main", "Replay as fast as possible rather than with the original timing."));
+    parser.addOption(fastOption);
+    parser.process(app);
+
     // TODO maybe #ifdef QT_NO_SYSTEMTRAYICON ...
     if (!QSystemTrayIcon::isSystemTrayAvailable()) {
         QMessageBox::critical(nullptr, QApplication::applicationName(),
-                              TrayIcon::tr("System tray unavailable"));
+                              TrayIcon::tr("System tray unavailable; try trayble-daemon instead."));
         return 1;
     }
     QApplication::setQuitOnLastWindowClosed(false);
 
+    // declared first so that it outlives TrayBle, which may still be decoding what it sent
+    BtSnoopReplay replay;
     TrayBle trayBle;
-    TrayIcon trayIcon(trayBle.settings());
+    TrayIcon trayIcon(trayBle.profiles(), trayBle.history());
 
+    // keep the tray from repainting for every reading
+    StatusPresenter presenter;
+    presenter.setMaxRate(trayBle.settings().value(QLatin1String("General/displayRate"), 2).toReal());
     QObject::connect(&trayBle, &TrayBle::readingUpdated,
-                     &trayIcon, &TrayIcon::showReading);
+                     &presenter, &StatusPresenter::setReading);
     QObject::connect(&trayBle, &TrayBle::error,
-                     &trayIcon, &TrayIcon::showError);
+                     &presenter, &StatusPresenter::reportError);
     QObject::connect(&trayBle, &TrayBle::statusChanged,
+                     &presenter, &StatusPresenter::setStatus);
+    QObject::connect(&trayBle, &TrayBle::notify,
+                     &presenter, &StatusPresenter::notify);
+    QObject::connect(&presenter, &StatusPresenter::readingChanged,
+                     &trayIcon, &TrayIcon::showReading);
+    QObject::connect(&presenter, &StatusPresenter::error,
+                     &trayIcon, &TrayIcon::showError);
+    QObject::connect(&presenter, &StatusPresenter::statusChanged,
                      &trayIcon, &TrayIcon::showTooltip);
-    QObject::connect(&trayBle, SIGNAL(notify(QString,QString)),
+    QObject::connect(&presenter, SIGNAL(notification(QString,QString)),
                      &trayIcon, SLOT(showMessage(QString,QString)));
+    QObject::connect(&trayIcon, &TrayIcon::statisticsRequested, [&]() {
+        trayIcon.showStatistics(trayBle.statistics() + QLatin1Char('\n') + presenter.statistics());
+    });
+    QObject::connect(&trayIcon, &TrayIcon::statisticsSaveRequested,
+                     &trayBle, &TrayBle::saveStatistics);
+    QObject::connect(&trayBle, &TrayBle::identificationRequested,
+                     &trayIcon, &TrayIcon::askIdentity);
+    QObject::connect(&trayIcon, &TrayIcon::identified,
+                     &trayBle, &TrayBle::identify);
 
 //    connect(trayIcon, &QSystemTrayIcon::messageClicked, &trayBle, &trayBle::messageClicked);
 //    connect(trayIcon, &QSystemTrayIcon::activated, &trayBle, &trayBle::iconActivated);
 
     trayIcon.show();
-    trayBle.deviceSearch();
+
+    if (parser.isSet(replayOption)) {
+        if (!replay.open(parser.value(replayOption))) {
+            qWarning() << replay.errorString();
+            return 1;
+        }
+        trayBle.setReplaying(true);
+        QObject::connect(&replay, &BtSnoopReplay::advertisement,
+                         &trayBle, &TrayBle::replayAdvertisement);
+        QObject::connect(&replay, &BtSnoopReplay::connected,
+                         &trayBle, &TrayBle::replayConnected);
+        QObject::connect(&replay, &BtSnoopReplay::notification,
+                         &trayBle, &TrayBle::replayNotification);
+        QObject::connect(&replay, &BtSnoopReplay::finished, [&]() {
+            trayBle.setStatus(replay.statistics());
+        });
+        replay.start(!parser.isSet(fastOption));
+    } else {
+        trayBle.deviceSearch();
+    }
+
+    qInfo().noquote() << QApplication::translate("main", "started in %1 ms;").arg(startup.elapsed())
+                      << ResourceUsage::summary();
     return app.exec();
 }
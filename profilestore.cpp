@@ -0,0 +1,186 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "profilestore.h"
+#include <QDebug>
+#include <QSettings>
+
+static const QLatin1String userGroups[] = {
+    QLatin1String("UserID"), QLatin1String("UserGender"), QLatin1String("UserExerciseLevel"),
+    QLatin1String("UserHeight"), QLatin1String("UserBirthday"), QLatin1String("UserUnits"),
+    QLatin1String("UserWeights")
+};
+
+/*!
+    The profile to write to the scale so that it computes body composition
+    for this user.
+*/
+QByteArray UserProfile::characteristic() const
+{
+    const quint8 gender = male ? 1 : 0;
+    const quint8 age = quint8(birthday.daysTo(QDate::currentDate()) / 365.25);
+    const quint8 checksum = id ^ gender ^ exerciseLevel ^ height ^ age ^ units;
+
+    QByteArray ret;
+    ret.reserve(8);
+    ret.append(char(0xfe));
+    ret.append(char(id));
+    ret.append(char(gender));
+    ret.append(char(exerciseLevel));
+    ret.append(char(height));
+    ret.append(char(age));
+    ret.append(char(units));
+    ret.append(char(checksum));
+    return ret;
+}
+
+ProfileStore::ProfileStore(QSettings &settings, QObject *parent)
+    : QObject(parent),
+      m_settings(settings)
+{
+    // one write for a burst of changes, but not put off forever by a steady trickle
+    m_writeTimer.setSingleShot(true);
+    m_writeTimer.setInterval(2000);
+    connect(&m_writeTimer, &QTimer::timeout, this, &ProfileStore::sync);
+}
+
+ProfileStore::~ProfileStore()
+{
+    sync();
+}
+
+void ProfileStore::load()
+{
+    m_users.clear();
+    for (const QLatin1String &group : userGroups) {
+        m_settings.beginGroup(group);
+        for (const QString &name : m_settings.childKeys())
+            m_users.insert(name, UserProfile());
+        m_settings.endGroup();
+    }
+    for (auto it = m_users.begin(); it != m_users.end(); ++it) {
+        const QString &name = it.key();
+        UserProfile &p = it.value();
+        p.id = quint8(m_settings.value(QLatin1String("UserID/") + name, 99).toInt());
+        p.male = m_settings.value(QLatin1String("UserGender/") + name, "m") == "m";
+        p.exerciseLevel = quint8(m_settings.value(QLatin1String("UserExerciseLevel/") + name, 0).toInt());
+        p.height = quint8(m_settings.value(QLatin1String("UserHeight/") + name, 170).toInt());
+        p.birthday = m_settings.value(QLatin1String("UserBirthday/") + name, QDate(1990, 1, 1)).toDate();
+        const QString units = m_settings.value(QLatin1String("UserUnits/") + name).toString();
+        p.units = units.startsWith(QLatin1Char('s')) ? UserProfile::Stones
+                : units.startsWith(QLatin1Char('p')) ? UserProfile::Pounds : UserProfile::Kilograms;
+        p.lastWeight = m_settings.value(QLatin1String("UserWeights/") + name, 0).toReal();
+    }
+
+    m_settings.beginGroup(QLatin1String("Aliases"));
+    for (const QString &key : m_settings.childKeys())
+        m_aliases.insert(key.toULongLong(nullptr, 16), m_settings.value(key).toString());
+    m_settings.endGroup();
+    m_settings.beginGroup(QLatin1String("Plants"));
+    for (const QString &key : m_settings.childKeys())
+        m_nameAliases.insert(key, m_settings.value(key).toString());
+    m_settings.endGroup();
+
+    m_lastUser = m_settings.value(QLatin1String("General/lastUser")).toString();
+}
+
+const UserProfile &ProfileStore::user(const QString &name) const
+{
+    static const UserProfile defaults;
+    auto it = m_users.constFind(name);
+    return it == m_users.constEnd() ? defaults : it.value();
+}
+
+void ProfileStore::setUser(const QString &name, const UserProfile &profile)
+{
+    m_users.insert(name, profile);
+    m_dirtyUsers.insert(name);
+    changed();
+    emit userChanged(name);
+}
+
+void ProfileStore::setLastWeight(const QString &name, qreal weight)
+{
+    m_users[name].lastWeight = weight;
+    m_dirtyUsers.insert(name);
+    changed();
+}
+
+void ProfileStore::setLastUser(const QString &name)
+{
+    if (name == m_lastUser)
+        return;
+    m_lastUser = name;
+    m_lastUserDirty = true;
+    changed();
+}
+
+/*!
+    Returns what the device at \a address has been named, or else what the
+    device advertising \a deviceName was named (as older versions recorded
+    it), or an empty string.
+*/
+QString ProfileStore::alias(const QBluetoothAddress &address, const QString &deviceName) const
+{
+    auto it = m_aliases.constFind(address.toUInt64());
+    if (it != m_aliases.constEnd())
+        return it.value();
+    return m_nameAliases.value(deviceName);
+}
+
+void ProfileStore::setAlias(const QBluetoothAddress &address, const QString &alias)
+{
+    m_aliases.insert(address.toUInt64(), alias);
+    m_dirtyAliases.insert(address.toUInt64());
+    changed();
+}
+
+void ProfileStore::changed()
+{
+    if (!m_writeTimer.isActive())
+        m_writeTimer.start();
+}
+
+void ProfileStore::sync()
+{
+    m_writeTimer.stop();
+    if (m_dirtyUsers.isEmpty() && m_dirtyAliases.isEmpty() && !m_lastUserDirty)
+        return;
+
+    static const char *const unitNames[] = { "stones", "kilograms", "pounds" };
+    for (const QString &name : m_dirtyUsers) {
+        const UserProfile &p = m_users[name];
+        m_settings.setValue(QLatin1String("UserID/") + name, p.id);
+        m_settings.setValue(QLatin1String("UserGender/") + name, p.male ? "m" : "f");
+        m_settings.setValue(QLatin1String("UserExerciseLevel/") + name, p.exerciseLevel);
+        m_settings.setValue(QLatin1String("UserHeight/") + name, p.height);
+        m_settings.setValue(QLatin1String("UserBirthday/") + name, p.birthday);
+        m_settings.setValue(QLatin1String("UserUnits/") + name, unitNames[p.units]);
+        if (p.lastWeight > 0)
+            m_settings.setValue(QLatin1String("UserWeights/") + name, p.lastWeight);
+    }
+    for (quint64 address : m_dirtyAliases)
+        m_settings.setValue(QLatin1String("Aliases/") + QString::number(address, 16), m_aliases.value(address));
+    if (m_lastUserDirty)
+        m_settings.setValue(QLatin1String("General/lastUser"), m_lastUser);
+
+    qDebug() << "saved" << m_dirtyUsers.count() << "users and" << m_dirtyAliases.count() << "aliases";
+    m_dirtyUsers.clear();
+    m_dirtyAliases.clear();
+    m_lastUserDirty = false;
+    m_settings.sync();
+}
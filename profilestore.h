@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef PROFILESTORE_H
+#define PROFILESTORE_H
+
+#include <QBluetoothAddress>
+#include <QDate>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+
+class QSettings;
+
+/*
+    What the scale needs to know about a user to compute body composition.
+*/
+struct UserProfile {
+    enum Units : quint8 { Stones = 0, Kilograms = 1, Pounds = 2 };
+
+    quint8 id = 99;
+    bool male = true;
+    quint8 exerciseLevel = 0;   // 0 not athletic, 1 amateur, 2 professional
+    quint8 height = 170;        // cm
+    QDate birthday = QDate(1990, 1, 1);
+    Units units = Kilograms;
+    qreal lastWeight = 0;       // kg; 0 if never weighed
+
+    QByteArray characteristic() const;
+};
+
+/*
+    Users and device aliases (e.g. which plant a sensor is in), held in
+    hashes so that looking them up while handling readings doesn't touch
+    QSettings.  Changes are written back in one batch, a moment after the
+    first change, or by sync().  The settings groups are the same as
+    before (UserID, UserGender, ..., UserWeights, Plants), so older
+    configurations keep working.
+*/
+class ProfileStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ProfileStore(QSettings &settings, QObject *parent = nullptr);
+    ~ProfileStore();
+
+    void load();
+    void setWriteDelay(int ms) { m_writeTimer.setInterval(ms); }
+
+    QStringList userNames() const { return m_users.keys(); }
+    bool isUser(const QString &name) const { return m_users.contains(name); }
+    const UserProfile &user(const QString &name) const;
+    void setUser(const QString &name, const UserProfile &profile);
+    void setLastWeight(const QString &name, qreal weight);
+
+    QString lastUser() const { return m_lastUser; }
+    void setLastUser(const QString &name);
+
+    QString alias(const QBluetoothAddress &address, const QString &deviceName) const;
+    void setAlias(const QBluetoothAddress &address, const QString &alias);
+
+public slots:
+    void sync();
+
+signals:
+    void userChanged(const QString &name);
+
+private:
+    void changed();
+
+private:
+    QSettings &m_settings;
+    QHash<QString, UserProfile> m_users;
+    QHash<quint64, QString> m_aliases;          // by address
+    QHash<QString, QString> m_nameAliases;      // by device name, from the Plants group
+    QString m_lastUser;
+    QSet<QString> m_dirtyUsers;
+    QSet<quint64> m_dirtyAliases;
+    bool m_lastUserDirty = false;
+    QTimer m_writeTimer;
+};
+
+#endif // PROFILESTORE_H
@@ -0,0 +1,57 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef READING_H
+#define READING_H
+
+#include <QMetaType>
+#include <QString>
+#include <chrono>
+#include "framedecoder.h"
+
+/*
+    One decoded measurement on its way to storage: what it is, what kind of
+    device measured it, whom or what it belongs to (one tag, such as the
+    user or the plant name), which device it came from and when.
+*/
+struct Reading {
+    QString deviceType;     // scale, plant
+    QString measurement;    // bodycomp, plants
+    QString tagKey;         // username, plant
+    QString tagValue;
+    QString device;         // Bluetooth address, if it came from a device session
+    qint64 timestamp = 0;   // nanoseconds since the epoch, when the frame arrived
+    FrameDecoder::Values values;
+
+    // a rollup of several readings (see RollupStage) ends at timestamp
+    // (window seconds after it started), and values holds the means
+    int window = 0;         // seconds; 0 for a single reading
+    quint32 count = 1;
+    FrameDecoder::Values min;
+    FrameDecoder::Values max;
+    FrameDecoder::Values last;
+
+    static qint64 now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+};
+
+Q_DECLARE_METATYPE(Reading)
+
+#endif // READING_H
@@ -0,0 +1,103 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "readingsink.h"
+#include <QMutexLocker>
+#include <QThread>
+
+ReadingSink::ReadingSink(const QString &name, QObject *parent)
+    : QObject(parent),
+      m_drainPosted(0),
+      m_posted(0), m_written(0), m_failed(0), m_dropped(0),
+      m_writeNs(0), m_maxWriteNs(0),
+      m_detailsTimer(this)
+{
+    setObjectName(name);
+    m_uptime.start();
+    m_detailsTimer.setInterval(1000);
+    connect(&m_detailsTimer, &QTimer::timeout, this, &ReadingSink::updateDetails);
+}
+
+void ReadingSink::start()
+{
+    m_detailsTimer.start();
+    open();
+    updateDetails();
+}
+
+void ReadingSink::receive(const Reading &reading)
+{
+    QElapsedTimer t;
+    t.start();
+    if (write(reading))
+        m_written.fetchAndAddRelaxed(1);
+    else
+        m_failed.fetchAndAddRelaxed(1);
+    const qint64 ns = t.nsecsElapsed();
+    m_writeNs.fetchAndAddRelaxed(ns);
+    if (ns > m_maxWriteNs.load())
+        m_maxWriteNs.store(ns); // only this thread writes it
+}
+
+/*!
+    Writes everything waiting in the queue.
+*/
+void ReadingSink::drain()
+{
+    // anything pushed after this gets another drain() posted; a full fence, so that
+    // the pops below can't see the queue as it was before the flag cleared
+    m_drainPosted.fetchAndStoreOrdered(0);
+    Reading reading;
+    while (m_queue.pop(&reading))
+        receive(reading);
+}
+
+/*!
+    Closes the sink after everything posted before this has been written,
+    and ends its thread.
+*/
+void ReadingSink::stop()
+{
+    drain();
+    m_detailsTimer.stop();
+    close();
+    updateDetails();
+    QThread::currentThread()->quit();
+}
+
+void ReadingSink::updateDetails()
+{
+    const QString d = details();
+    QMutexLocker lock(&m_detailsMutex);
+    m_details = d;
+}
+
+QString ReadingSink::statistics() const
+{
+    const quint64 done = m_written.load() + m_failed.load();
+    const qint64 elapsed = qMax(qint64(1), m_uptime.elapsed());
+    QString ret = tr("%1: %2 written, %3 failed, %4 dropped, backlog %5 (at most %9), %6 readings/min, mean %7 us, max %8 us per reading")
+            .arg(name()).arg(m_written.load()).arg(m_failed.load()).arg(m_dropped.load()).arg(backlog())
+            .arg(m_written.load() * 60000.0 / elapsed, 0, 'f', 1)
+            .arg(done ? m_writeNs.load() / 1000.0 / done : 0, 0, 'f', 1)
+            .arg(m_maxWriteNs.load() / 1000.0, 0, 'f', 1)
+            .arg(m_queue.highWater());
+    QMutexLocker lock(&m_detailsMutex);
+    if (!m_details.isEmpty())
+        ret += QLatin1String("\n    ") + m_details;
+    return ret;
+}
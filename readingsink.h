@@ -0,0 +1,87 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef READINGSINK_H
+#define READINGSINK_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+#include <QTimer>
+#include "reading.h"
+#include "spscring.h"
+
+/*
+    A destination for readings.  Each sink lives on its own thread (see
+    SinkPipeline), so write() may block on the disk or the network without
+    holding up anything else.  Readings arrive through a lock-free ring
+    rather than one queued event each.  The counters can be read from any
+    thread.
+*/
+class ReadingSink : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ReadingSink(const QString &name, QObject *parent = nullptr);
+
+    QString name() const { return objectName(); }
+
+    quint64 postedCount() const { return m_posted.load(); }
+    quint64 writtenCount() const { return m_written.load(); }
+    quint64 failedCount() const { return m_failed.load(); }
+    quint64 droppedCount() const { return m_dropped.load(); }
+    quint64 backlog() const { return m_posted.load() - m_written.load() - m_failed.load(); }
+    int queueHighWater() const { return m_queue.highWater(); }
+    QString statistics() const;
+
+public slots:
+    void start();
+    void receive(const Reading &reading);
+    void drain();
+    void stop();
+
+signals:
+    void error(QString message);
+
+protected:
+    virtual void open() {}
+    virtual bool write(const Reading &reading) = 0;
+    virtual void close() {}
+    virtual QString details() const { return QString(); }
+
+private:
+    void updateDetails();
+
+private:
+    friend class SinkPipeline;
+    SpscRing<Reading> m_queue;          // filled by SinkPipeline::deliver()
+    QAtomicInt m_drainPosted;           // whether drain() is already on its way
+    QAtomicInteger<quint64> m_posted;
+    QAtomicInteger<quint64> m_written;
+    QAtomicInteger<quint64> m_failed;
+    QAtomicInteger<quint64> m_dropped;  // by the pipeline, because the backlog was too long
+    QAtomicInteger<qint64> m_writeNs;
+    QAtomicInteger<qint64> m_maxWriteNs;
+    QElapsedTimer m_uptime;
+    QTimer m_detailsTimer;
+    mutable QMutex m_detailsMutex;
+    QString m_details;  // snapshot of details(), taken on the sink's thread
+};
+
+#endif // READINGSINK_H
@@ -0,0 +1,67 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "resourceusage.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QList>
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace ResourceUsage {
+
+qint64 residentBytes()
+{
+#ifdef Q_OS_LINUX
+    // size, resident, shared, ... in pages
+    QFile statm(QLatin1String("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly))
+        return -1;
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.count() < 2)
+        return -1;
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
+
+qint64 peakResidentBytes()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return -1;
+#ifdef Q_OS_DARWIN
+    return usage.ru_maxrss;         // bytes
+#else
+    return usage.ru_maxrss * 1024;  // KiB
+#endif
+#else
+    return -1;
+#endif
+}
+
+QString summary()
+{
+    return QCoreApplication::translate("ResourceUsage", "memory: %1 KiB resident, %2 KiB at most")
+            .arg(residentBytes() / 1024).arg(peakResidentBytes() / 1024);
+}
+
+} // namespace ResourceUsage
@@ -0,0 +1,35 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef RESOURCEUSAGE_H
+#define RESOURCEUSAGE_H
+
+#include <QString>
+
+/*
+    How much of the machine trayble is using, so that the daemon and the
+    tray app can be compared, and a collector on a small board watched.
+*/
+namespace ResourceUsage {
+
+qint64 residentBytes();     // -1 if the platform doesn't say
+qint64 peakResidentBytes(); // -1 if the platform doesn't say
+QString summary();
+
+} // namespace ResourceUsage
+
+#endif // RESOURCEUSAGE_H
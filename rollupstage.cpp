@@ -0,0 +1,175 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "rollupstage.h"
+#include <algorithm>
+
+static const qint64 nsPerSecond = 1000000000;
+
+RollupStage::RollupStage(QObject *parent)
+    : QObject(parent),
+      m_timer(this) // so that it moves along to another thread
+{
+    setWindows(QVector<int>() << 60 << 15 * 60 << 60 * 60);
+    // windows also have to close when a sensor goes quiet
+    m_timer.setInterval(10000);
+    connect(&m_timer, &QTimer::timeout, this, &RollupStage::closeExpired);
+    m_timer.start();
+}
+
+void RollupStage::setWindows(const QVector<int> &seconds)
+{
+    m_windows = seconds;
+    std::sort(m_windows.begin(), m_windows.end());
+    m_series.clear();
+}
+
+QString RollupStage::windowLabel(int seconds)
+{
+    if (seconds % 3600 == 0)
+        return QString::number(seconds / 3600) + QLatin1Char('h');
+    if (seconds % 60 == 0)
+        return QString::number(seconds / 60) + QLatin1Char('m');
+    return QString::number(seconds) + QLatin1Char('s');
+}
+
+void RollupStage::add(Window &w, const FrameDecoder::Values &values)
+{
+    for (int q = 0; q < FrameDecoder::QuantityCount; ++q) {
+        const FrameDecoder::Quantity quantity = FrameDecoder::Quantity(q);
+        if (!values.has(quantity))
+            continue;
+        const qreal v = values[quantity];
+        if (w.sum.has(quantity)) {
+            w.sum.value[q] += v;
+            w.min.value[q] = qMin(w.min.value[q], v);
+            w.max.value[q] = qMax(w.max.value[q], v);
+        } else {
+            w.sum.value[q] = w.min.value[q] = w.max.value[q] = v;
+        }
+        w.last.value[q] = v;
+        ++w.counts[q];
+    }
+    w.sum.present |= values.present;
+    w.min.present = w.max.present = w.last.present = w.sum.present;
+    ++w.count;
+}
+
+void RollupStage::process(const Reading &reading)
+{
+    if (!m_measurements.contains(reading.measurement) || m_windows.isEmpty()) {
+        emit output(reading);
+        return;
+    }
+    ++m_input;
+
+    const QString key = reading.measurement + QLatin1Char('/') + reading.tagValue;
+    auto it = m_series.find(key);
+    if (it == m_series.end()) {
+        it = m_series.insert(key, Series());
+        it->windows.resize(m_windows.count());
+    }
+    Series &s = *it;
+    s.latest = reading;
+
+    for (int i = 0; i < m_windows.count(); ++i) {
+        const qint64 length = m_windows.at(i) * nsPerSecond;
+        const qint64 start = reading.timestamp - reading.timestamp % length;
+        if (s.windows.at(i).start >= 0 && s.windows.at(i).start != start)
+            close(s, i);
+        s.windows[i].start = start;
+        add(s.windows[i], reading.values);
+    }
+
+    // a big change shouldn't have to wait for the window to close
+    for (int q = 0; q < FrameDecoder::QuantityCount; ++q) {
+        const FrameDecoder::Quantity quantity = FrameDecoder::Quantity(q);
+        if (m_deadband[q] > 0 && reading.values.has(quantity)
+                && (!s.passedOn.has(quantity) || qAbs(reading.values[quantity] - s.passedOn[quantity]) > m_deadband[q])) {
+            ++m_deadbandOutput;
+            passOn(s, reading);
+            break;
+        }
+    }
+}
+
+void RollupStage::passOn(Series &s, const Reading &reading)
+{
+    for (int q = 0; q < FrameDecoder::QuantityCount; ++q)
+        if (reading.values.has(FrameDecoder::Quantity(q)))
+            s.passedOn.value[q] = reading.values.value[q];
+    s.passedOn.present |= reading.values.present;
+    ++m_output;
+    emit output(reading);
+}
+
+void RollupStage::close(Series &s, int window)
+{
+    Window &w = s.windows[window];
+    if (w.start < 0 || !w.count)
+        return;
+
+    Reading out = s.latest;
+    if (window > 0)
+        out.measurement += QLatin1Char('_') + windowLabel(m_windows.at(window));
+    out.window = m_windows.at(window);
+    // Stamped at the end, so that it's later than any reading passed on
+    // early (for the deadband) under the same name; or if it's being cut
+    // short, now, which is still later.
+    out.timestamp = qMin(w.start + m_windows.at(window) * nsPerSecond, Reading::now());
+    out.count = w.count;
+    out.values = w.sum;
+    for (int q = 0; q < FrameDecoder::QuantityCount; ++q)
+        if (w.counts[q])
+            out.values.value[q] /= w.counts[q];
+    out.min = w.min;
+    out.max = w.max;
+    out.last = w.last;
+    w = Window();
+
+    if (window == 0)
+        passOn(s, out);
+    else {
+        ++m_output;
+        emit output(out);
+    }
+}
+
+void RollupStage::closeExpired()
+{
+    const qint64 now = Reading::now();
+    for (Series &s : m_series)
+        for (int i = 0; i < m_windows.count(); ++i)
+            if (s.windows.at(i).start >= 0 && s.windows.at(i).start + m_windows.at(i) * nsPerSecond <= now)
+                close(s, i);
+}
+
+/*!
+    Passes on all the windows that are still open, e.g. before quitting.
+*/
+void RollupStage::closeAll()
+{
+    for (Series &s : m_series)
+        for (int i = 0; i < m_windows.count(); ++i)
+            close(s, i);
+}
+
+QString RollupStage::statistics() const
+{
+    return tr("rollup: %1 readings in, %2 out (%3 for big changes), %4 series")
+            .arg(m_input).arg(m_output).arg(m_deadbandOutput).arg(m_series.count());
+}
@@ -0,0 +1,94 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef ROLLUPSTAGE_H
+#define ROLLUPSTAGE_H
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+#include "reading.h"
+
+/*
+    Aggregates frequent readings (plant sensors advertise several times a
+    second) into fixed windows aligned to the clock, e.g. 1 minute, 15
+    minutes and 1 hour, keeping count, min, max, mean and last of each
+    quantity incrementally.  Only closed windows are passed on: the
+    shortest under the original measurement name, so existing graphs keep
+    working, and the longer ones as e.g. plants_15m.  A reading that
+    differs from the last one passed on by more than the deadband for some
+    quantity is passed on immediately as well.  Each window is stamped
+    with the time it ends, so that every series stays in time order.
+
+    Readings of other measurements go straight through.
+*/
+class RollupStage : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RollupStage(QObject *parent = nullptr);
+
+    void setMeasurements(const QStringList &measurements) { m_measurements = measurements; }
+    void setWindows(const QVector<int> &seconds);
+    void setDeadband(FrameDecoder::Quantity quantity, qreal deadband) { m_deadband[quantity] = deadband; }
+
+    quint64 inputCount() const { return m_input; }
+    quint64 outputCount() const { return m_output; }
+    QString statistics() const;
+
+    static QString windowLabel(int seconds);
+
+public slots:
+    void process(const Reading &reading);
+    void closeExpired();
+    void closeAll();
+
+signals:
+    void output(const Reading &reading);
+
+private:
+    struct Window {
+        qint64 start = -1;  // ns; -1 if nothing has been added yet
+        quint32 count = 0;
+        quint32 counts[FrameDecoder::QuantityCount] = {};
+        FrameDecoder::Values sum, min, max, last;
+    };
+    struct Series {
+        Reading latest;                 // for the tags
+        QVector<Window> windows;
+        FrameDecoder::Values passedOn;  // last values passed on, for the deadband
+    };
+
+    void add(Window &w, const FrameDecoder::Values &values);
+    void close(Series &s, int window);
+    void passOn(Series &s, const Reading &reading);
+
+private:
+    QStringList m_measurements;
+    QVector<int> m_windows;     // seconds
+    qreal m_deadband[FrameDecoder::QuantityCount] = {};
+    QHash<QString, Series> m_series;
+    QTimer m_timer;
+    quint64 m_input = 0;
+    quint64 m_output = 0;
+    quint64 m_deadbandOutput = 0;
+};
+
+#endif // ROLLUPSTAGE_H
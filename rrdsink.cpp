@@ -0,0 +1,108 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "rrdsink.h"
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QRegExp>
+
+RrdSink::RrdSink(const QString &directory, int step, QObject *parent)
+    : ReadingSink(QLatin1String("rrd"), parent),
+      m_directory(directory),
+      m_step(step)
+{
+}
+
+bool RrdSink::run(const QStringList &arguments, QByteArray *output)
+{
+    QProcess rrdtool;
+    rrdtool.start(m_rrdtool, arguments);
+    if (!rrdtool.waitForFinished(10000) || rrdtool.exitStatus() != QProcess::NormalExit || rrdtool.exitCode()) {
+        QString message = QString::fromLocal8Bit(rrdtool.readAllStandardError()).trimmed();
+        if (message.isEmpty())
+            message = rrdtool.errorString();
+        emit error(tr("rrdtool %1: %2").arg(arguments.first()).arg(message));
+        return false;
+    }
+    if (output)
+        *output = rrdtool.readAllStandardOutput();
+    return true;
+}
+
+bool RrdSink::create(const QString &fileName, const Reading &reading)
+{
+    QDir().mkpath(m_directory);
+    QStringList args;
+    args << QLatin1String("create") << fileName
+         << QLatin1String("--start") << QString::number(reading.timestamp / 1000000000 - 1)
+         << QLatin1String("--step") << QString::number(m_step);
+    // readings can be days apart (scales), so allow long gaps
+    const QString heartbeat = QString::number(qMax(m_step * 2, 7 * 24 * 3600));
+    for (int q = 0; q < FrameDecoder::QuantityCount; ++q)
+        if (reading.values.has(FrameDecoder::Quantity(q)))
+            args << QLatin1String("DS:%1:GAUGE:%2:U:U")
+                    .arg(QLatin1String(FrameDecoder::quantityName(FrameDecoder::Quantity(q)))).arg(heartbeat);
+    // every step for a week, hourly for a year, daily for ten years
+    const int perHour = qMax(1, 3600 / m_step);
+    const int perDay = qMax(1, 86400 / m_step);
+    for (const char *cf : { "AVERAGE", "MIN", "MAX" }) {
+        args << QLatin1String("RRA:%1:0.5:1:%2").arg(QLatin1String(cf)).arg(7 * perDay)
+             << QLatin1String("RRA:%1:0.5:%2:%3").arg(QLatin1String(cf)).arg(perHour).arg(366 * 24)
+             << QLatin1String("RRA:%1:0.5:%2:%3").arg(QLatin1String(cf)).arg(perDay).arg(3660);
+    }
+    return run(args);
+}
+
+bool RrdSink::write(const Reading &reading)
+{
+    QString tag = reading.tagValue;
+    tag.replace(QRegExp(QLatin1String("[^A-Za-z0-9_-]")), QLatin1String("_"));
+    const QString fileName = m_directory + QLatin1Char('/') + reading.measurement
+            + QLatin1Char('-') + tag + QLatin1String(".rrd");
+    auto last = m_lastUpdate.find(fileName);
+    if (last == m_lastUpdate.end()) {
+        qint64 lastUpdate = 0;
+        if (!QFile::exists(fileName)) {
+            if (!create(fileName, reading))
+                return false;
+        } else {
+            // left from a previous run, which may have written up to a moment ago
+            QByteArray output;
+            if (run(QStringList() << QLatin1String("last") << fileName, &output))
+                lastUpdate = output.trimmed().toLongLong();
+        }
+        last = m_lastUpdate.insert(fileName, lastUpdate);
+    }
+    const qint64 second = reading.timestamp / 1000000000;
+    if (second <= *last)
+        return true; // not an error; rrdtool would reject it
+
+    QStringList names;
+    QString update = QString::number(second);
+    for (int q = 0; q < FrameDecoder::QuantityCount; ++q) {
+        if (reading.values.has(FrameDecoder::Quantity(q))) {
+            names << QLatin1String(FrameDecoder::quantityName(FrameDecoder::Quantity(q)));
+            update += QLatin1Char(':') + QString::number(reading.values[FrameDecoder::Quantity(q)]);
+        }
+    }
+    if (!run(QStringList() << QLatin1String("update") << fileName
+             << QLatin1String("--template") << names.join(QLatin1Char(':')) << update))
+        return false;
+    *last = second;
+    return true;
+}
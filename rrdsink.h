@@ -0,0 +1,55 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef RRDSINK_H
+#define RRDSINK_H
+
+#include <QHash>
+#include "readingsink.h"
+
+/*
+    Feeds readings to round-robin databases by running rrdtool: one .rrd
+    file per measurement and tag value (e.g. per user or per plant), with
+    a data source for each quantity, created on first use.  rrdtool takes
+    at most one update per second per file, so a reading in the same
+    second as the last one written (e.g. a deadband reading right after a
+    rollup) is skipped.
+*/
+class RrdSink : public ReadingSink
+{
+    Q_OBJECT
+
+public:
+    explicit RrdSink(const QString &directory, int step = 300, QObject *parent = nullptr);
+
+    void setRrdTool(const QString &program) { m_rrdtool = program; }
+
+protected:
+    bool write(const Reading &reading) override;
+
+private:
+    bool run(const QStringList &arguments, QByteArray *output = nullptr);
+    bool create(const QString &fileName, const Reading &reading);
+
+private:
+    QString m_directory;
+    QString m_rrdtool = QLatin1String("rrdtool");
+    int m_step;
+    QHash<QString, qint64> m_lastUpdate;   // by file name: seconds since the epoch
+};
+
+#endif // RRDSINK_H
@@ -0,0 +1,118 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "scanscheduler.h"
+#include <QBluetoothDeviceDiscoveryAgent>
+#include <QDebug>
+
+ScanScheduler::ScanScheduler(QBluetoothDeviceDiscoveryAgent *agent, QObject *parent)
+    : QObject(parent),
+      m_agent(agent)
+{
+    m_uptime.start();
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::VeryCoarseTimer);
+    connect(&m_timer, &QTimer::timeout, this, [this]() {
+        if (m_scanning)
+            closeWindow();
+        else
+            openWindow();
+    });
+}
+
+void ScanScheduler::start()
+{
+    if (!m_running) {
+        m_running = true;
+        openWindow();
+    } else if (m_scanning && !m_agent->isActive()) {
+        // BlueZ may stop discovery by itself, e.g. while connecting
+        m_agent->start();
+    }
+}
+
+void ScanScheduler::stop()
+{
+    m_running = false;
+    m_timer.stop();
+    if (m_scanning) {
+        m_agent->stop();
+        m_scanTimeMs += m_scanStart.elapsed();
+        m_scanning = false;
+        emit scanningChanged(false);
+    }
+}
+
+void ScanScheduler::boost()
+{
+    if (!m_running || isContinuous())
+        return;
+    m_boostUntil = m_uptime.elapsed() + m_boostMs;
+    if (!m_scanning)
+        openWindow();
+}
+
+void ScanScheduler::openWindow()
+{
+    ++m_wakeups;
+    m_agent->start();
+    m_scanStart.start();
+    m_scanning = true;
+    emit scanningChanged(true);
+    if (!isContinuous())
+        m_timer.start(qMax(qint64(m_windowMs), m_boostUntil - m_uptime.elapsed()));
+}
+
+void ScanScheduler::closeWindow()
+{
+    const qint64 boostLeft = m_boostUntil - m_uptime.elapsed();
+    if (boostLeft > 0) {
+        m_timer.start(boostLeft);
+        return;
+    }
+    m_agent->stop();
+    m_scanTimeMs += m_scanStart.elapsed();
+    m_scanning = false;
+    emit scanningChanged(false);
+    qDebug() << statistics();
+    m_timer.start(m_periodMs - m_windowMs);
+}
+
+qreal ScanScheduler::wakeupsPerSecond() const
+{
+    const qint64 up = m_uptime.elapsed();
+    return up > 0 ? m_wakeups * 1000.0 / up : 0;
+}
+
+qint64 ScanScheduler::scanTime() const
+{
+    return m_scanTimeMs + (m_scanning ? m_scanStart.elapsed() : 0);
+}
+
+qreal ScanScheduler::dutyCycle() const
+{
+    const qint64 up = m_uptime.elapsed();
+    return up > 0 ? qreal(scanTime()) / up : 0;
+}
+
+QString ScanScheduler::statistics() const
+{
+    return tr("scanned %1 s of %2 s (%3%), %4 wakeups (%5/s)")
+            .arg(scanTime() / 1000).arg(m_uptime.elapsed() / 1000)
+            .arg(dutyCycle() * 100, 0, 'f', 1)
+            .arg(m_wakeups).arg(wakeupsPerSecond(), 0, 'f', 4);
+}
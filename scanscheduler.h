@@ -0,0 +1,79 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef SCANSCHEDULER_H
+#define SCANSCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+class QBluetoothDeviceDiscoveryAgent;
+
+/*
+    Runs the discovery agent in windows: scan for window ms out of every
+    period ms, and sleep in between.  boost() switches to continuous
+    scanning for a while, e.g. after a scale has been seen, because a
+    measurement is likely to follow.  A window of 0 (or one as long as
+    the period) means scanning all the time, as before.
+*/
+class ScanScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ScanScheduler(QBluetoothDeviceDiscoveryAgent *agent, QObject *parent = nullptr);
+
+    void setWindow(int ms) { m_windowMs = ms; }
+    void setPeriod(int ms) { m_periodMs = ms; }
+    void setBoostDuration(int ms) { m_boostMs = ms; }
+    bool isContinuous() const { return m_windowMs <= 0 || m_windowMs >= m_periodMs; }
+
+    void start();
+    void stop();
+    void boost();
+    bool isScanning() const { return m_scanning; }
+
+    quint64 wakeups() const { return m_wakeups; }
+    qreal wakeupsPerSecond() const;
+    qint64 scanTime() const;
+    qreal dutyCycle() const;
+    QString statistics() const;
+
+signals:
+    void scanningChanged(bool scanning);
+
+private slots:
+    void openWindow();
+    void closeWindow();
+
+private:
+    QBluetoothDeviceDiscoveryAgent *m_agent;
+    QTimer m_timer;
+    QElapsedTimer m_uptime;
+    QElapsedTimer m_scanStart;
+    qint64 m_scanTimeMs = 0;
+    qint64 m_boostUntil = 0;
+    quint64 m_wakeups = 0;
+    int m_windowMs = 0;
+    int m_periodMs = 60000;
+    int m_boostMs = 120000;
+    bool m_running = false;
+    bool m_scanning = false;
+};
+
+#endif // SCANSCHEDULER_H
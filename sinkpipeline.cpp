@@ -0,0 +1,94 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "sinkpipeline.h"
+#include "readingsink.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QThread>
+
+SinkPipeline::SinkPipeline(QObject *parent)
+    : QObject(parent)
+{
+    qRegisterMetaType<Reading>();
+}
+
+SinkPipeline::~SinkPipeline()
+{
+    shutdown();
+}
+
+/*!
+    Takes ownership of \a sink and starts its thread.
+*/
+void SinkPipeline::addSink(ReadingSink *sink)
+{
+    QThread *thread = new QThread;
+    thread->setObjectName(sink->name());
+    sink->setParent(nullptr);
+    sink->m_queue.setCapacity(m_maxBacklog);
+    sink->moveToThread(thread);
+    connect(thread, &QThread::finished, sink, &QObject::deleteLater);
+    thread->start();
+    QMetaObject::invokeMethod(sink, "start", Qt::QueuedConnection);
+    m_sinks.append(sink);
+    m_threads.append(thread);
+}
+
+void SinkPipeline::deliver(const Reading &reading)
+{
+    for (ReadingSink *sink : m_sinks) {
+        if (!sink->m_queue.push(reading)) {
+            sink->m_dropped.fetchAndAddRelaxed(1);
+            continue;
+        }
+        sink->m_posted.fetchAndAddRelaxed(1);
+        // one event wakes the sink for as many readings as arrive before it runs
+        if (!sink->m_drainPosted.fetchAndStoreOrdered(1))
+            QMetaObject::invokeMethod(sink, "drain", Qt::QueuedConnection);
+    }
+}
+
+/*!
+    Lets each sink finish what it has queued, waiting up to \a timeoutMs
+    in total.
+*/
+void SinkPipeline::shutdown(int timeoutMs)
+{
+    if (m_sinks.isEmpty())
+        return;
+    for (ReadingSink *sink : m_sinks)
+        QMetaObject::invokeMethod(sink, "stop", Qt::QueuedConnection);
+    QElapsedTimer t;
+    t.start();
+    for (QThread *thread : m_threads) {
+        if (thread->wait(ulong(qMax(qint64(0), timeoutMs - t.elapsed()))))
+            delete thread;
+        else // leave it be rather than pull the rug out from under it
+            qWarning() << "sink" << thread->objectName() << "didn't finish in time";
+    }
+    m_sinks.clear();
+    m_threads.clear();
+}
+
+QString SinkPipeline::statistics() const
+{
+    QStringList ret;
+    for (const ReadingSink *sink : m_sinks)
+        ret << sink->statistics();
+    return ret.join(QLatin1Char('\n'));
+}
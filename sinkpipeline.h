@@ -0,0 +1,59 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef SINKPIPELINE_H
+#define SINKPIPELINE_H
+
+#include <QObject>
+#include <QVector>
+#include "reading.h"
+
+class QThread;
+class ReadingSink;
+
+/*
+    Fans each reading out to every configured sink.  Every sink gets a
+    thread of its own and a queue of maxBacklog readings; if a sink falls
+    that far behind, further readings for it are dropped (and counted)
+    rather than piling up forever.  The queues are single-producer rings,
+    so deliver() must always be called from the same thread.
+*/
+class SinkPipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SinkPipeline(QObject *parent = nullptr);
+    ~SinkPipeline();
+
+    void addSink(ReadingSink *sink);
+    QVector<ReadingSink *> sinks() const { return m_sinks; }
+    void setMaxBacklog(int readings) { m_maxBacklog = readings; } // before adding sinks
+
+    QString statistics() const;
+
+public slots:
+    void deliver(const Reading &reading);
+    void shutdown(int timeoutMs = 5000);
+
+private:
+    QVector<ReadingSink *> m_sinks;
+    QVector<QThread *> m_threads;
+    int m_maxBacklog = 10000;
+};
+
+#endif // SINKPIPELINE_H
@@ -0,0 +1,271 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "spool.h"
+#include <QDebug>
+#include <QDir>
+#include <QtEndian>
+#include <unistd.h>
+
+static const int recordHeaderSize = 8; // length, CRC-32; both little-endian
+static const quint32 maxRecordSize = 16 * 1024 * 1024;
+static const QLatin1String segmentSuffix(".spool");
+
+Spool::Spool(const QString &directory, qint64 maxSegmentBytes)
+    : m_directory(directory),
+      m_maxSegmentBytes(maxSegmentBytes)
+{
+}
+
+Spool::~Spool()
+{
+    sync();
+    m_writeFile.close();
+    // don't leave an empty (i.e. fully delivered) segment behind
+    if (m_segments.value(m_writeSegment).size == 0)
+        QFile::remove(fileName(m_writeSegment));
+}
+
+namespace {
+struct Crc32Table {
+    quint32 entries[256];
+    Crc32Table()
+    {
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            entries[i] = c;
+        }
+    }
+};
+}
+
+/*!
+    Safe to call from any thread: the table is built by the first caller
+    and C++11 makes the others wait for it.
+*/
+quint32 Spool::crc32(const char *data, int length)
+{
+    static const Crc32Table table;
+    quint32 crc = 0xffffffff;
+    for (int i = 0; i < length; ++i)
+        crc = table.entries[(crc ^ uchar(data[i])) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffff;
+}
+
+QString Spool::fileName(quint32 segment) const
+{
+    return m_directory + QLatin1Char('/') + QString::number(segment).rightJustified(8, QLatin1Char('0')) + segmentSuffix;
+}
+
+/*!
+    Finds the segments left from previous runs, positions the reader at the
+    oldest one and starts a new segment for writing.
+*/
+bool Spool::open()
+{
+    QDir dir(m_directory);
+    if (!dir.mkpath(QLatin1String("."))) {
+        m_error = QObject::tr("can't create %1").arg(m_directory);
+        return false;
+    }
+    quint32 last = 0;
+    for (const QFileInfo &fi : dir.entryInfoList(QStringList() << QLatin1Char('*') + segmentSuffix, QDir::Files)) {
+        bool ok = false;
+        const quint32 id = fi.completeBaseName().toUInt(&ok);
+        if (!ok)
+            continue;
+        Segment seg;
+        seg.size = fi.size();
+        m_segments.insert(id, seg);
+        last = qMax(last, id);
+    }
+    if (!m_segments.isEmpty())
+        qDebug() << m_directory << ":" << m_segments.count() << "segments left to replay";
+    m_readSegment = m_segments.isEmpty() ? last + 1 : m_segments.firstKey();
+    m_firstWriteSegment = last + 1;
+    return startSegment(last + 1);
+}
+
+bool Spool::startSegment(quint32 segment)
+{
+    m_writeFile.close();
+    m_writeFile.setFileName(fileName(segment));
+    if (!m_writeFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        m_error = m_writeFile.errorString();
+        return false;
+    }
+    m_writeSegment = segment;
+    m_segments.insert(segment, Segment());
+    return true;
+}
+
+bool Spool::append(const QByteArray &record)
+{
+    if (!m_writeFile.isOpen())
+        return false;
+    if (m_segments[m_writeSegment].size >= m_maxSegmentBytes) {
+        const quint32 previous = m_writeSegment;
+        if (!startSegment(m_writeSegment + 1))
+            return false;
+        removeIfDone(previous);
+    }
+
+    uchar header[recordHeaderSize];
+    qToLittleEndian<quint32>(quint32(record.size()), header);
+    qToLittleEndian<quint32>(crc32(record.constData(), record.size()), header + 4);
+    if (m_writeFile.write(reinterpret_cast<const char *>(header), recordHeaderSize) != recordHeaderSize
+            || m_writeFile.write(record) != record.size() || !m_writeFile.flush()) {
+        m_error = m_writeFile.errorString();
+        return false;
+    }
+    m_segments[m_writeSegment].size += recordHeaderSize + record.size();
+    m_unsynced = true;
+    return true;
+}
+
+/*!
+    Waits until everything appended so far is on disk, not just handed to
+    the OS, so that it survives a power cut.
+*/
+bool Spool::sync()
+{
+    if (!m_unsynced || !m_writeFile.isOpen())
+        return true;
+    m_unsynced = false;
+    if (!m_writeFile.flush() || ::fsync(m_writeFile.handle()) != 0) {
+        m_error = m_writeFile.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool Spool::openForReading(quint32 segment)
+{
+    m_readFile.close();
+    m_readFile.setFileName(fileName(segment));
+    m_readSegment = segment;
+    m_readOffset = 0;
+    return m_readFile.open(QIODevice::ReadOnly);
+}
+
+void Spool::finishReading()
+{
+    m_readFile.close();
+    const quint32 done = m_readSegment;
+    m_segments[done].fullyRead = true;
+    auto next = m_segments.upperBound(done);
+    m_readSegment = next == m_segments.end() ? m_writeSegment : next.key();
+    removeIfDone(done);
+}
+
+/*!
+    Reads the next record that hasn't been read yet.  Returns false if there
+    is none right now.  Every record read must eventually be acknowledged
+    with the \a segment it came from.
+*/
+bool Spool::readNext(QByteArray *record, quint32 *segment)
+{
+    while (true) {
+        if (!m_segments.contains(m_readSegment))
+            return false;
+        const bool writing = m_readSegment == m_writeSegment;
+        const qint64 size = m_segments.value(m_readSegment).size;
+        if (!m_readFile.isOpen() && !openForReading(m_readSegment)) {
+            if (writing)
+                return false;
+            qWarning() << "can't read spool segment" << m_readFile.fileName() << m_readFile.errorString();
+            finishReading();
+            continue;
+        }
+
+        // older segments may have a torn record at the end; ours never do
+        const qint64 available = writing ? size - m_readOffset : m_readFile.size() - m_readOffset;
+        if (available < recordHeaderSize) {
+            if (writing)
+                return false;
+            finishReading();
+            continue;
+        }
+
+        uchar header[recordHeaderSize];
+        m_readFile.seek(m_readOffset);
+        if (m_readFile.read(reinterpret_cast<char *>(header), recordHeaderSize) != recordHeaderSize) {
+            finishReading();
+            continue;
+        }
+        const quint32 length = qFromLittleEndian<quint32>(header);
+        const quint32 crc = qFromLittleEndian<quint32>(header + 4);
+        if (length > maxRecordSize || available < recordHeaderSize + length) {
+            if (!writing)
+                qWarning() << "truncated record in" << m_readFile.fileName() << "at" << m_readOffset;
+            finishReading();
+            continue;
+        }
+        QByteArray data = m_readFile.read(length);
+        if (data.size() != int(length) || crc32(data.constData(), data.size()) != crc) {
+            qWarning() << "corrupt record in" << m_readFile.fileName() << "at" << m_readOffset;
+            finishReading();
+            continue;
+        }
+
+        m_readOffset += recordHeaderSize + length;
+        ++m_segments[m_readSegment].unacknowledged;
+        *record = data;
+        *segment = m_readSegment;
+        return true;
+    }
+}
+
+void Spool::acknowledge(quint32 segment, int count)
+{
+    auto it = m_segments.find(segment);
+    if (it == m_segments.end())
+        return;
+    it->unacknowledged -= count;
+    removeIfDone(segment);
+}
+
+void Spool::removeIfDone(quint32 segment)
+{
+    auto it = m_segments.find(segment);
+    if (it == m_segments.end())
+        return;
+    if (segment == m_writeSegment) {
+        // everything written so far has been delivered: start the segment over
+        if (m_readSegment == segment && m_readOffset == it->size && it->unacknowledged == 0 && it->size > 0
+                && m_writeFile.resize(0)) {
+            it->size = 0;
+            m_readOffset = 0;
+        }
+        return;
+    }
+    // a segment that was being written when it was rotated out still needs reading to the end
+    if (!it->fullyRead || it->unacknowledged > 0)
+        return;
+    QFile::remove(fileName(segment));
+    m_segments.erase(it);
+}
+
+qint64 Spool::backlogBytes() const
+{
+    qint64 ret = 0;
+    for (auto it = m_segments.lowerBound(m_readSegment); it != m_segments.end(); ++it)
+        ret += it->size;
+    return ret - m_readOffset;
+}
@@ -0,0 +1,85 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <QFile>
+#include <QMap>
+#include <QString>
+
+/*
+    An append-only on-disk queue of records, used as a write-ahead log for
+    readings on their way to a database.  Records are written to numbered
+    segment files, each record prefixed with its length and a CRC-32.
+    Records are read back in the order they were appended, including those
+    left over from a previous run; a segment file is deleted once it has
+    been read to the end and all of its records have been acknowledged.
+    The segment being written is truncated whenever everything in it has
+    been read and acknowledged, so delivered records aren't sent again
+    after a restart.  A torn or corrupt record (e.g. after a crash) ends
+    its segment.  append() only flushes to the OS; sync() makes what has
+    been appended durable, and is meant to be called once per batch.
+*/
+class Spool
+{
+public:
+    explicit Spool(const QString &directory, qint64 maxSegmentBytes = 1024 * 1024);
+    ~Spool();
+
+    bool open();
+    QString errorString() const { return m_error; }
+
+    bool append(const QByteArray &record);
+    bool sync();
+    bool readNext(QByteArray *record, quint32 *segment);
+    void acknowledge(quint32 segment, int count = 1);
+
+    quint32 firstSegmentOfThisRun() const { return m_firstWriteSegment; }
+    qint64 backlogBytes() const;
+    int segmentCount() const { return m_segments.count(); }
+
+    static quint32 crc32(const char *data, int length);
+
+private:
+    struct Segment {
+        qint64 size = 0;
+        int unacknowledged = 0;
+        bool fullyRead = false;
+    };
+
+    QString fileName(quint32 segment) const;
+    bool startSegment(quint32 segment);
+    bool openForReading(quint32 segment);
+    void finishReading();
+    void removeIfDone(quint32 segment);
+
+private:
+    QString m_directory;
+    qint64 m_maxSegmentBytes;
+    QMap<quint32, Segment> m_segments;
+    QFile m_writeFile;
+    quint32 m_writeSegment = 0;
+    quint32 m_firstWriteSegment = 0;
+    bool m_unsynced = false;
+    QFile m_readFile;
+    quint32 m_readSegment = 0;
+    qint64 m_readOffset = 0;
+    QString m_error;
+};
+
+#endif // SPOOL_H
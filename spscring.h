@@ -0,0 +1,98 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <QAtomicInteger>
+#include <utility>
+#include <vector>
+
+/*
+    A bounded queue for handing items from one thread to one other thread
+    without locks: the producer only ever writes the head and the consumer
+    only ever writes the tail, so neither ever waits for the other.  When
+    it's full, push() fails (and counts the item as dropped) rather than
+    blocking the producer.  size() and the counters may be read from any
+    thread.
+*/
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(int capacity = 1024) { setCapacity(capacity); }
+
+    /*! Only while neither thread is using it yet. */
+    void setCapacity(int capacity)
+    {
+        m_slots.assign(size_t(qMax(1, capacity)), T());
+        m_head.store(0);
+        m_tail.store(0);
+    }
+
+    int capacity() const { return int(m_slots.size()); }
+
+    int size() const
+    {
+        const quint64 tail = m_tail.loadAcquire(); // first, so that head can't be behind it
+        return int(m_head.loadAcquire() - tail);
+    }
+
+    int highWater() const { return m_highWater.load(); }
+    quint64 droppedCount() const { return m_dropped.load(); }
+
+    /*! Called only by the producer. */
+    bool push(const T &item)
+    {
+        const quint64 head = m_head.load();
+        const quint64 tail = m_tail.loadAcquire();
+        if (head - tail >= m_slots.size()) {
+            m_dropped.fetchAndAddRelaxed(1);
+            return false;
+        }
+        m_slots[head % m_slots.size()] = item;
+        m_head.storeRelease(head + 1);
+        if (int(head + 1 - tail) > m_highWater.load())
+            m_highWater.store(int(head + 1 - tail)); // only the producer writes it
+        return true;
+    }
+
+    /*! Called only by the consumer. */
+    bool pop(T *item)
+    {
+        const quint64 tail = m_tail.load();
+        if (tail == m_head.loadAcquire())
+            return false;
+        T &slot = m_slots[tail % m_slots.size()];
+        *item = std::move(slot);
+        slot = T(); // don't keep anything alive that the item refers to
+        m_tail.storeRelease(tail + 1);
+        return true;
+    }
+
+private:
+    std::vector<T> m_slots;
+    // keep the producer's and the consumer's positions on separate cache lines
+    QAtomicInteger<quint64> m_head;    // next slot to write
+    char m_padding[64 - sizeof(QAtomicInteger<quint64>)];
+    QAtomicInteger<quint64> m_tail;    // next slot to read
+    char m_padding2[64 - sizeof(QAtomicInteger<quint64>)];
+    QAtomicInteger<int> m_highWater;
+    QAtomicInteger<quint64> m_dropped;
+};
+
+#endif // SPSCRING_H
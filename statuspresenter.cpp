@@ -0,0 +1,133 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "statuspresenter.h"
+
+// more than this many notifications at once are more than anyone reads
+static const int maxNotifications = 3;
+static const qint64 errorRepeatInterval = 60000; // ms
+
+StatusPresenter::StatusPresenter(QObject *parent)
+    : QObject(parent)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &StatusPresenter::flush);
+    m_sinceFlush.start();
+}
+
+void StatusPresenter::setMaxRate(qreal perSecond)
+{
+    m_interval = perSecond > 0 ? int(1000 / perSecond) : 0;
+}
+
+void StatusPresenter::setStatus(const QString &message)
+{
+    ++m_updates;
+    // either the pending one never makes it to the screen, or this one changes nothing
+    if (m_status != m_shownStatus || message == m_shownStatus)
+        ++m_suppressed;
+    m_status = message;
+    if (m_status != m_shownStatus)
+        schedule();
+}
+
+void StatusPresenter::setReading(const QString &context, const QString &values)
+{
+    ++m_updates;
+    auto it = m_readings.find(context);
+    if (it != m_readings.end()) {
+        ++m_suppressed;
+        *it = values;
+    } else if (m_shownReadings.value(context) != values) {
+        m_readings.insert(context, values);
+    } else {
+        ++m_suppressed;
+        return;
+    }
+    schedule();
+}
+
+void StatusPresenter::notify(const QString &title, const QString &message)
+{
+    ++m_updates;
+    m_notifications.append(qMakePair(title, message));
+    ++m_urgentFlushes;
+    flush();
+}
+
+void StatusPresenter::reportError(const QString &message)
+{
+    ++m_updates;
+    // the same error over and over again needn't pop up every time
+    if (m_errors.contains(message) || (message == m_lastError && m_sinceError.isValid()
+                                       && m_sinceError.elapsed() < errorRepeatInterval)) {
+        ++m_suppressed;
+        return;
+    }
+    m_errors.append(message);
+    ++m_urgentFlushes;
+    flush();
+}
+
+void StatusPresenter::schedule()
+{
+    if (m_timer.isActive())
+        return;
+    m_timer.start(int(qMax(qint64(0), m_interval - m_sinceFlush.elapsed())));
+}
+
+void StatusPresenter::flush()
+{
+    m_timer.stop();
+    m_sinceFlush.restart();
+    ++m_flushes;
+
+    for (auto it = m_readings.constBegin(); it != m_readings.constEnd(); ++it) {
+        m_shownReadings.insert(it.key(), it.value());
+        emit readingChanged(it.key(), it.value());
+    }
+    m_readings.clear();
+
+    if (m_status != m_shownStatus) {
+        m_shownStatus = m_status;
+        emit statusChanged(m_status);
+    }
+
+    // only the latest few balloons: each one hides the one before
+    while (m_notifications.count() > maxNotifications) {
+        m_notifications.removeFirst();
+        ++m_suppressed;
+    }
+    for (const auto &n : m_notifications)
+        emit notification(n.first, n.second);
+    m_notifications.clear();
+
+    for (const QString &e : m_errors)
+        emit error(e);
+    if (!m_errors.isEmpty()) {
+        m_lastError = m_errors.last();
+        m_sinceError.start();
+    }
+    m_errors.clear();
+}
+
+QString StatusPresenter::statistics() const
+{
+    return tr("display: %1 updates, %2 suppressed, %3 refreshes (%4 urgent), at most %5 per second")
+            .arg(m_updates).arg(m_suppressed).arg(m_flushes).arg(m_urgentFlushes)
+            .arg(m_interval ? 1000.0 / m_interval : 0, 0, 'f', 1);
+}
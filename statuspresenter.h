@@ -0,0 +1,82 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef STATUSPRESENTER_H
+#define STATUSPRESENTER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+
+/*
+    Stands between TrayBle and the tray icon, so that a crowd of sensors
+    can't cause a storm of repaints: it keeps the latest status, the latest
+    reading for each device and any pending notifications, and passes on
+    what has changed at most maxRate times a second.  Errors and
+    notifications (new scale readings) are urgent and go out right away,
+    along with whatever else is pending.  Updates that are overwritten
+    before they are shown are counted as suppressed.
+*/
+class StatusPresenter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit StatusPresenter(QObject *parent = nullptr);
+
+    void setMaxRate(qreal perSecond);
+    QString statistics() const;
+
+public slots:
+    void setStatus(const QString &message);
+    void setReading(const QString &context, const QString &values);
+    void notify(const QString &title, const QString &message);
+    void reportError(const QString &message);
+
+signals:
+    void statusChanged(const QString &message);
+    void readingChanged(QString context, QString values);
+    void notification(const QString &title, const QString &message);
+    void error(const QString &message);
+
+private:
+    void schedule();
+    void flush();
+
+private:
+    QTimer m_timer;
+    QElapsedTimer m_sinceFlush;
+    int m_interval = 500;           // ms
+
+    QString m_status;
+    QString m_shownStatus;
+    QHash<QString, QString> m_readings;         // by context, since the last flush
+    QHash<QString, QString> m_shownReadings;    // by context
+    QList<QPair<QString, QString>> m_notifications;
+    QStringList m_errors;
+    QString m_lastError;
+    QElapsedTimer m_sinceError;
+
+    quint64 m_updates = 0;
+    quint64 m_suppressed = 0;
+    quint64 m_flushes = 0;
+    quint64 m_urgentFlushes = 0;
+};
+
+#endif // STATUSPRESENTER_H
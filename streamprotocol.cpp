@@ -0,0 +1,219 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "streamprotocol.h"
+#include <QStringList>
+#include <QtEndian>
+#include <cstring>
+
+namespace StreamProtocol {
+
+static const int maxStringLength = 255;
+
+bool Filter::matches(const Reading &reading) const
+{
+    switch (key) {
+    case DeviceType:
+        return reading.deviceType == value;
+    case Measurement:
+        return reading.measurement == value;
+    case User:
+        return reading.tagKey == QLatin1String("username") && reading.tagValue == value;
+    case Device:
+        return reading.device.compare(value, Qt::CaseInsensitive) == 0;
+    case Series:
+        return value.size() == reading.measurement.size() + 1 + reading.tagValue.size()
+                && value.startsWith(reading.measurement) && value.at(reading.measurement.size()) == QLatin1Char('/')
+                && value.endsWith(reading.tagValue);
+    }
+    return false;
+}
+
+/*!
+    Parses comma-separated filters such as "type:plant, device:C4:7C:8D:6A:1B:2C"
+    into \a filters.  Returns false, leaving \a filters alone, if any of
+    them doesn't make sense.
+*/
+bool parseFilters(const QString &text, QVector<Filter> *filters)
+{
+    static const struct { const char *name; Filter::Key key; } keys[] = {
+        { "type", Filter::DeviceType },
+        { "measurement", Filter::Measurement },
+        { "user", Filter::User },
+        { "device", Filter::Device },
+        { "series", Filter::Series },
+    };
+    QVector<Filter> ret;
+    for (const QString &f : text.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+        // device addresses have colons too, so split at the first
+        const int colon = f.indexOf(QLatin1Char(':'));
+        if (colon < 0)
+            return false;
+        const QString key = f.left(colon).trimmed();
+        bool ok = false;
+        Filter filter;
+        for (const auto &k : keys) {
+            if (key == QLatin1String(k.name)) {
+                filter.key = k.key;
+                ok = true;
+            }
+        }
+        if (!ok)
+            return false;
+        filter.value = f.mid(colon + 1).trimmed();
+        ret.append(filter);
+    }
+    *filters = ret;
+    return true;
+}
+
+/*!
+    No filters at all means everything; otherwise any one of them is enough.
+*/
+bool matches(const QVector<Filter> &filters, const Reading &reading)
+{
+    if (filters.isEmpty())
+        return true;
+    for (const Filter &filter : filters)
+        if (filter.matches(reading))
+            return true;
+    return false;
+}
+
+template <typename T>
+static void append(QByteArray *out, T value)
+{
+    const int size = out->size();
+    out->resize(size + int(sizeof(T)));
+    qToLittleEndian(value, out->data() + size);
+}
+
+static void appendString(QByteArray *out, const QString &s)
+{
+    QByteArray utf8 = s.toUtf8();
+    utf8.truncate(maxStringLength);
+    out->append(char(utf8.size()));
+    out->append(utf8);
+}
+
+static void appendValues(QByteArray *out, const FrameDecoder::Values &values, quint32 present)
+{
+    for (int q = 0; q < FrameDecoder::QuantityCount; ++q) {
+        if (present & (1u << q)) {
+            quint64 bits;
+            memcpy(&bits, &values.value[q], sizeof(bits));
+            append(out, bits);
+        }
+    }
+}
+
+/*!
+    Appends \a reading to \a out, without a frame header: timestamp (ns,
+    64 bits), window (s, 32 bits), count (32 bits), the bitmask of values
+    present (32 bits, by FrameDecoder::Quantity), then device type,
+    measurement, tag key, tag value and device address as a length byte
+    and UTF-8, then the values present as doubles, in quantity order;
+    then for a rollup (window != 0) the minima, maxima and last values.
+*/
+void appendReading(QByteArray *out, const Reading &reading)
+{
+    append(out, reading.timestamp);
+    append(out, qint32(reading.window));
+    append(out, reading.count);
+    append(out, reading.values.present);
+    appendString(out, reading.deviceType);
+    appendString(out, reading.measurement);
+    appendString(out, reading.tagKey);
+    appendString(out, reading.tagValue);
+    appendString(out, reading.device);
+    appendValues(out, reading.values, reading.values.present);
+    if (reading.window) {
+        appendValues(out, reading.min, reading.values.present);
+        appendValues(out, reading.max, reading.values.present);
+        appendValues(out, reading.last, reading.values.present);
+    }
+}
+
+namespace {
+struct Reader {
+    const char *p;
+    const char *end;
+
+    template <typename T>
+    bool read(T *value)
+    {
+        if (end - p < int(sizeof(T)))
+            return false;
+        *value = qFromLittleEndian<T>(p);
+        p += sizeof(T);
+        return true;
+    }
+
+    bool readString(QString *s)
+    {
+        if (p >= end || end - p < 1 + quint8(*p))
+            return false;
+        const int length = quint8(*p);
+        *s = QString::fromUtf8(p + 1, length);
+        p += 1 + length;
+        return true;
+    }
+
+    bool readValues(FrameDecoder::Values *values, quint32 present)
+    {
+        values->present = present;
+        for (int q = 0; q < FrameDecoder::QuantityCount; ++q) {
+            if (!(present & (1u << q)))
+                continue;
+            quint64 bits;
+            if (!read(&bits))
+                return false;
+            memcpy(&values->value[q], &bits, sizeof(bits));
+        }
+        return true;
+    }
+};
+}
+
+/*!
+    The reverse of appendReading(), for clients written with Qt.
+*/
+bool readReading(const char *data, int length, Reading *reading)
+{
+    Reader r = { data, data + length };
+    qint32 window;
+    quint32 present;
+    if (!r.read(&reading->timestamp) || !r.read(&window) || !r.read(&reading->count) || !r.read(&present)
+            || !r.readString(&reading->deviceType) || !r.readString(&reading->measurement)
+            || !r.readString(&reading->tagKey) || !r.readString(&reading->tagValue)
+            || !r.readString(&reading->device) || !r.readValues(&reading->values, present))
+        return false;
+    reading->window = window;
+    if (window && (!r.readValues(&reading->min, present) || !r.readValues(&reading->max, present)
+                   || !r.readValues(&reading->last, present)))
+        return false;
+    return true;
+}
+
+void appendFrame(QByteArray *out, FrameType type, const QByteArray &payload)
+{
+    append(out, quint32(payload.size() + 1));
+    out->append(char(type));
+    out->append(payload);
+}
+
+} // namespace StreamProtocol
@@ -0,0 +1,63 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef STREAMPROTOCOL_H
+#define STREAMPROTOCOL_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include "reading.h"
+
+/*
+    The framing used by StreamSink to stream readings to local clients
+    (see doc/stream.md).  Every frame is a 32-bit little-endian length (of
+    what follows), a type byte and the payload; a reading is a few fixed
+    fields, five short strings and one double per value present.
+*/
+namespace StreamProtocol {
+
+enum FrameType : quint8 {
+    Subscribe = 1,      // client to server: filters, as UTF-8 text
+    ReadingFrame = 2,   // server to client: one reading
+    RingInfo = 3        // server to client: where the shared ring is
+};
+
+static const int frameHeaderSize = 5;
+
+/*
+    Chooses readings by device type, measurement, user, device address or
+    series (measurement/tag value), written e.g. "measurement:plants".
+*/
+struct Filter {
+    enum Key { DeviceType, Measurement, User, Device, Series };
+    Key key;
+    QString value;
+
+    bool matches(const Reading &reading) const;
+};
+
+bool parseFilters(const QString &text, QVector<Filter> *filters);
+bool matches(const QVector<Filter> &filters, const Reading &reading);
+
+void appendReading(QByteArray *out, const Reading &reading);
+bool readReading(const char *data, int length, Reading *reading);
+void appendFrame(QByteArray *out, FrameType type, const QByteArray &payload);
+
+} // namespace StreamProtocol
+
+#endif // STREAMPROTOCOL_H
@@ -0,0 +1,227 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "streamsink.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QtEndian>
+#include <atomic>
+#include <cstring>
+
+// a client more than this far behind misses readings until it catches up
+static const qint64 maxClientBacklog = 1 << 20;
+
+// the ring file: a header, then ringSlots slots of ringSlotSize bytes
+static const quint32 ringMagic = 0x53524254; // "TBRS" in little-endian order
+static const quint32 ringVersion = 1;
+static const int ringHeaderSize = 64;
+static const int slotHeaderSize = 12;
+
+struct RingHeader {
+    quint32 magic;
+    quint32 version;
+    quint32 slotSize;
+    quint32 slotCount;
+    std::atomic<quint64> written;   // how many readings have been published
+};
+
+struct RingSlot {
+    std::atomic<quint64> sequence;  // 2n + 1 while reading n is being written, 2n + 2 when it's done
+    quint32 length;
+    uchar data[1];
+};
+
+StreamSink::StreamSink(const QString &socketPath, const QString &ringPath, int ringSlots, int ringSlotSize,
+                       QObject *parent)
+    : ReadingSink(QLatin1String("stream"), parent),
+      m_socketPath(socketPath),
+      m_ringPath(ringPath),
+      m_ringSlots(ringSlots),
+      m_ringSlotSize(qMax(64, ringSlotSize) & ~7)
+{
+    Q_STATIC_ASSERT(sizeof(RingHeader) <= ringHeaderSize);
+}
+
+StreamSink::~StreamSink()
+{
+    close();
+}
+
+void StreamSink::open()
+{
+    m_server = new QLocalServer(this);
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    bool listening = m_server->listen(m_socketPath);
+    if (!listening && m_server->serverError() == QAbstractSocket::AddressInUseError) {
+        // either another instance is streaming, or it's left over after a crash
+        QLocalSocket probe;
+        probe.connectToServer(m_socketPath);
+        if (probe.waitForConnected(1000)) {
+            emit error(tr("can't stream readings on %1: another instance is using it").arg(m_socketPath));
+            return; // and leave its ring alone too
+        }
+        QLocalServer::removeServer(m_socketPath);
+        listening = m_server->listen(m_socketPath);
+    }
+    if (listening)
+        connect(m_server, &QLocalServer::newConnection, this, &StreamSink::acceptClients);
+    else
+        emit error(tr("can't stream readings on %1: %2").arg(m_socketPath).arg(m_server->errorString()));
+
+    if (!m_ringPath.isEmpty() && m_ringSlots > 0 && !openRing())
+        emit error(tr("can't share readings in %1: %2").arg(m_ringPath).arg(m_ringFile.errorString()));
+}
+
+bool StreamSink::openRing()
+{
+    QDir().mkpath(QFileInfo(m_ringPath).absolutePath());
+    m_ringFile.setFileName(m_ringPath);
+    // start afresh: readers notice the new header
+    const qint64 size = ringHeaderSize + qint64(m_ringSlots) * m_ringSlotSize;
+    if (!m_ringFile.open(QIODevice::ReadWrite | QIODevice::Truncate) || !m_ringFile.resize(size))
+        return false;
+    m_ring = m_ringFile.map(0, size);
+    if (!m_ring)
+        return false;
+    memset(m_ring, 0, size_t(size));
+    RingHeader *header = reinterpret_cast<RingHeader *>(m_ring);
+    header->version = ringVersion;
+    header->slotSize = quint32(m_ringSlotSize);
+    header->slotCount = quint32(m_ringSlots);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = ringMagic; // last, so a reader never sees a half-made header
+    return true;
+}
+
+void StreamSink::writeRing(const QByteArray &record)
+{
+    if (record.size() > m_ringSlotSize - slotHeaderSize) {
+        ++m_ringTooBig;
+        return;
+    }
+    RingHeader *header = reinterpret_cast<RingHeader *>(m_ring);
+    RingSlot *slot = reinterpret_cast<RingSlot *>(m_ring + ringHeaderSize
+                                                  + (m_ringWritten % quint64(m_ringSlots)) * m_ringSlotSize);
+    // a seqlock: readers check that the sequence is the same before and after copying
+    slot->sequence.store(2 * m_ringWritten + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->length = quint32(record.size());
+    memcpy(slot->data, record.constData(), size_t(record.size()));
+    slot->sequence.store(2 * m_ringWritten + 2, std::memory_order_release);
+    header->written.store(++m_ringWritten, std::memory_order_release);
+}
+
+bool StreamSink::write(const Reading &reading)
+{
+    m_record.resize(0);
+    StreamProtocol::appendReading(&m_record, reading);
+    if (m_ring)
+        writeRing(m_record);
+
+    if (m_clients.isEmpty())
+        return true;
+    m_frame.resize(0);
+    StreamProtocol::appendFrame(&m_frame, StreamProtocol::ReadingFrame, m_record);
+    for (auto it = m_clients.begin(); it != m_clients.end(); ++it) {
+        if (!StreamProtocol::matches(it->filters, reading))
+            continue;
+        if (it.key()->bytesToWrite() > maxClientBacklog) {
+            ++it->dropped;
+            ++m_droppedForClients;
+            continue;
+        }
+        it.key()->write(m_frame);
+        ++it->sent;
+        m_bytesSent += quint64(m_frame.size());
+    }
+    return true;
+}
+
+void StreamSink::acceptClients()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        m_clients.insert(socket, Client());
+        connect(socket, &QLocalSocket::readyRead, this, &StreamSink::readClient);
+        connect(socket, &QLocalSocket::disconnected, this, &StreamSink::dropClient);
+        if (m_ring) {
+            QByteArray frame;
+            StreamProtocol::appendFrame(&frame, StreamProtocol::RingInfo, m_ringPath.toUtf8());
+            socket->write(frame);
+        }
+    }
+}
+
+void StreamSink::readClient()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    auto it = m_clients.find(socket);
+    if (it == m_clients.end())
+        return;
+    it->received += socket->readAll();
+    while (it->received.size() >= StreamProtocol::frameHeaderSize) {
+        const quint32 length = qFromLittleEndian<quint32>(it->received.constData());
+        if (length < 1 || length > 4096) {
+            qWarning() << "stream client sent nonsense; disconnecting";
+            socket->disconnectFromServer();
+            return;
+        }
+        if (quint32(it->received.size()) < 4 + length)
+            return;
+        const StreamProtocol::FrameType type = StreamProtocol::FrameType(it->received.at(4));
+        const QString payload = QString::fromUtf8(it->received.constData() + StreamProtocol::frameHeaderSize,
+                                                  int(length) - 1);
+        it->received.remove(0, int(4 + length));
+        if (type == StreamProtocol::Subscribe && !StreamProtocol::parseFilters(payload, &it->filters))
+            qWarning() << "ignoring stream filters" << payload;
+    }
+}
+
+void StreamSink::dropClient()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    m_clients.remove(socket);
+    socket->deleteLater();
+}
+
+void StreamSink::close()
+{
+    for (QLocalSocket *socket : m_clients.keys()) {
+        socket->disconnect(this);
+        socket->flush();
+        delete socket;
+    }
+    m_clients.clear();
+    delete m_server;
+    m_server = nullptr;
+    if (m_ring) {
+        m_ringFile.unmap(m_ring);
+        m_ring = nullptr;
+        m_ringFile.remove();
+    }
+}
+
+QString StreamSink::details() const
+{
+    QString ret = tr("%n client(s), %1 KiB sent, %2 dropped for slow clients", nullptr, m_clients.count())
+            .arg(m_bytesSent / 1024).arg(m_droppedForClients);
+    if (m_ring)
+        ret += tr("; ring: %1 written, %2 too big").arg(m_ringWritten).arg(m_ringTooBig);
+    return ret;
+}
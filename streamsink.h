@@ -0,0 +1,91 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef STREAMSINK_H
+#define STREAMSINK_H
+
+#include <QFile>
+#include <QHash>
+#include <QVector>
+#include "readingsink.h"
+#include "streamprotocol.h"
+
+class QLocalServer;
+class QLocalSocket;
+
+/*
+    Streams readings to local programs as they are decoded, so that
+    dashboards and scripts don't have to poll the database.  Clients
+    connect to a Unix socket and may subscribe with filters; each gets only
+    the readings that match, in the binary framing of StreamProtocol.
+    A client that doesn't keep up loses readings rather than holding up
+    the others.
+
+    For consumers that want everything at a high rate, every reading is
+    also written to a ring in a shared memory-mapped file, which they can
+    read without any system call per reading (see doc/stream.md).
+*/
+class StreamSink : public ReadingSink
+{
+    Q_OBJECT
+
+public:
+    StreamSink(const QString &socketPath, const QString &ringPath, int ringSlots, int ringSlotSize,
+               QObject *parent = nullptr);
+    ~StreamSink();
+
+protected:
+    void open() override;
+    bool write(const Reading &reading) override;
+    void close() override;
+    QString details() const override;
+
+private slots:
+    void acceptClients();
+    void readClient();
+    void dropClient();
+
+private:
+    bool openRing();
+    void writeRing(const QByteArray &record);
+
+private:
+    struct Client {
+        QVector<StreamProtocol::Filter> filters;
+        QByteArray received;    // an incomplete frame
+        quint64 sent = 0;
+        quint64 dropped = 0;    // because it wasn't keeping up
+    };
+
+    QString m_socketPath;
+    QLocalServer *m_server = nullptr;
+    QHash<QLocalSocket *, Client> m_clients;
+    QByteArray m_record;
+    QByteArray m_frame;
+    quint64 m_bytesSent = 0;
+    quint64 m_droppedForClients = 0;
+
+    QFile m_ringFile;
+    QString m_ringPath;
+    int m_ringSlots;
+    int m_ringSlotSize;
+    uchar *m_ring = nullptr;
+    quint64 m_ringWritten = 0;
+    quint64 m_ringTooBig = 0;   // readings too big for a slot
+};
+
+#endif // STREAMSINK_H
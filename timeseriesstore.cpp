@@ -0,0 +1,600 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "timeseriesstore.h"
+#include "spool.h"
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QtAlgorithms>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+static const char fileMagic[8] = { 'T', 'B', 'T', 'S', 'D', 'B', '1', '\0' };
+static const quint32 blockMagic = 0x4b4c4254; // "TBLK"
+// magic, series, count, payload bytes, earliest time, latest time, min, max, CRC-32
+static const int blockHeaderSize = 4 + 4 + 4 + 4 + 8 + 8 + 8 + 8 + 4;
+static const quint32 maxBlockPoints = 1024;
+static const quint32 headsMagic = 0x44484254; // "TBHD"
+
+class TimeSeriesStore::Encoder
+{
+public:
+    QByteArray data;
+    quint64 bits = 0;
+    quint32 count = 0;
+    qint64 first = 0;   // earliest
+    qint64 last = 0;    // latest
+    double min = 0;
+    double max = 0;
+
+    void append(qint64 time, double value);
+    void clear() { *this = Encoder(); }
+
+private:
+    void write(quint64 value, int n);
+
+    qint64 m_time = 0;  // of the previous point
+    qint64 m_delta = 0;
+    quint64 m_value = 0;
+    int m_leading = -1; // of the previous XOR window; -1 if there is none yet
+    int m_trailing = 0;
+};
+
+void TimeSeriesStore::Encoder::write(quint64 value, int n)
+{
+    while (n > 0) {
+        if (bits % 8 == 0)
+            data.append('\0');
+        const int free = 8 - int(bits % 8);
+        const int take = qMin(free, n);
+        const uint chunk = uint(value >> (n - take)) & ((1u << take) - 1);
+        data.data()[data.size() - 1] |= char(chunk << (free - take));
+        bits += take;
+        n -= take;
+    }
+}
+
+void TimeSeriesStore::Encoder::append(qint64 time, double value)
+{
+    quint64 v;
+    memcpy(&v, &value, sizeof(v));
+    if (count == 0) {
+        write(quint64(time), 64);
+        write(v, 64);
+        first = last = time;
+        min = max = value;
+    } else {
+        // timestamp: delta of delta, in the smallest bucket it fits
+        const qint64 delta = time - m_time;
+        const qint64 dod = delta - m_delta;
+        if (dod == 0) {
+            write(0, 1);
+        } else if (dod >= -63 && dod <= 64) {
+            write(0x2, 2);
+            write(quint64(dod + 63), 7);
+        } else if (dod >= -255 && dod <= 256) {
+            write(0x6, 3);
+            write(quint64(dod + 255), 9);
+        } else if (dod >= -2047 && dod <= 2048) {
+            write(0xe, 4);
+            write(quint64(dod + 2047), 12);
+        } else {
+            write(0xf, 4);
+            write(quint64(dod), 64);
+        }
+        m_delta = delta;
+
+        // value: XOR with the previous one, storing only the bits in between the zeros
+        const quint64 x = v ^ m_value;
+        if (x == 0) {
+            write(0, 1);
+        } else {
+            const int leading = qMin(31, int(qCountLeadingZeroBits(x)));
+            const int trailing = int(qCountTrailingZeroBits(x));
+            if (m_leading >= 0 && leading >= m_leading && trailing >= m_trailing) {
+                write(0x2, 2);
+                write(x >> m_trailing, 64 - m_leading - m_trailing);
+            } else {
+                const int meaningful = 64 - leading - trailing;
+                write(0x3, 2);
+                write(quint64(leading), 5);
+                write(quint64(meaningful & 63), 6); // 64 doesn't fit; it's stored as 0
+                write(x >> trailing, meaningful);
+                m_leading = leading;
+                m_trailing = trailing;
+            }
+        }
+        min = qMin(min, value);
+        max = qMax(max, value);
+        first = qMin(first, time);
+        last = qMax(last, time);
+    }
+    m_value = v;
+    m_time = time;
+    ++count;
+}
+
+namespace {
+class BitReader
+{
+public:
+    BitReader(const uchar *data, quint32 bytes) : m_data(data), m_bits(quint64(bytes) * 8) { }
+
+    bool read(int n, quint64 *out)
+    {
+        if (m_pos + n > m_bits)
+            return false;
+        quint64 v = 0;
+        while (n > 0) {
+            const int avail = 8 - int(m_pos % 8);
+            const int take = qMin(avail, n);
+            v = (v << take) | ((m_data[m_pos / 8] >> (avail - take)) & ((1u << take) - 1));
+            m_pos += take;
+            n -= take;
+        }
+        *out = v;
+        return true;
+    }
+
+    // number of 1 bits before a 0, up to max
+    bool ones(int max, int *out)
+    {
+        quint64 bit;
+        int n = 0;
+        while (n < max) {
+            if (!read(1, &bit))
+                return false;
+            if (!bit)
+                break;
+            ++n;
+        }
+        *out = n;
+        return true;
+    }
+
+private:
+    const uchar *m_data;
+    quint64 m_bits;
+    quint64 m_pos = 0;
+};
+}
+
+void TimeSeriesStore::decode(const uchar *data, quint32 bytes, quint32 count, qint64 from, qint64 to, QVector<Point> *out)
+{
+    BitReader in(data, bytes);
+    quint64 t, v;
+    if (!count || !in.read(64, &t) || !in.read(64, &v))
+        return;
+    qint64 time = qint64(t);
+    qint64 delta = 0;
+    int leading = 0, trailing = 0;
+    for (quint32 i = 0; ; ) {
+        // not necessarily in order, so there's no stopping early at to
+        if (time >= from && time <= to) {
+            double value;
+            memcpy(&value, &v, sizeof(value));
+            out->append(Point { time, value });
+        }
+        if (++i == count)
+            return;
+
+        int control;
+        quint64 bits;
+        if (!in.ones(4, &control))
+            return;
+        switch (control) {
+        case 0:
+            break;
+        case 1:
+            if (!in.read(7, &bits))
+                return;
+            delta += qint64(bits) - 63;
+            break;
+        case 2:
+            if (!in.read(9, &bits))
+                return;
+            delta += qint64(bits) - 255;
+            break;
+        case 3:
+            if (!in.read(12, &bits))
+                return;
+            delta += qint64(bits) - 2047;
+            break;
+        default:
+            if (!in.read(64, &bits))
+                return;
+            delta += qint64(bits);
+            break;
+        }
+        time += delta;
+
+        if (!in.ones(2, &control))
+            return;
+        if (control == 1) {
+            if (!in.read(64 - leading - trailing, &bits))
+                return;
+            v ^= bits << trailing;
+        } else if (control == 2) {
+            quint64 l, m;
+            if (!in.read(5, &l) || !in.read(6, &m))
+                return;
+            const int meaningful = m ? int(m) : 64;
+            leading = int(l);
+            trailing = 64 - leading - meaningful;
+            if (!in.read(meaningful, &bits))
+                return;
+            v ^= bits << trailing;
+        }
+    }
+}
+
+TimeSeriesStore::TimeSeriesStore(const QString &directory)
+    : m_directory(directory)
+{
+}
+
+TimeSeriesStore::~TimeSeriesStore()
+{
+    flush();
+    if (m_map)
+        m_mapFile.unmap(const_cast<uchar *>(m_map));
+    for (Series *s : m_seriesById) {
+        delete s->head;
+        delete s;
+    }
+}
+
+bool TimeSeriesStore::open()
+{
+    QMutexLocker lock(&m_mutex);
+    if (!QDir().mkpath(m_directory)) {
+        m_error = QObject::tr("can't create %1").arg(m_directory);
+        return false;
+    }
+
+    // series names, one per line, in order of their IDs
+    m_seriesFile.setFileName(m_directory + QLatin1String("/series"));
+    if (!m_seriesFile.open(QIODevice::ReadWrite | QIODevice::Append | QIODevice::Text)) {
+        m_error = m_seriesFile.errorString();
+        return false;
+    }
+    m_seriesFile.seek(0);
+    while (!m_seriesFile.atEnd()) {
+        const QString name = QString::fromUtf8(m_seriesFile.readLine()).trimmed();
+        Series *s = new Series;
+        s->id = quint32(m_seriesById.count());
+        s->name = name;
+        m_seriesById.append(s);
+        if (!name.isEmpty())
+            m_series.insert(name, s);
+    }
+
+    m_dataFile.setFileName(m_directory + QLatin1String("/blocks"));
+    if (!m_dataFile.open(QIODevice::ReadWrite)) {
+        m_error = m_dataFile.errorString();
+        return false;
+    }
+    if (m_dataFile.size() == 0) {
+        m_dataFile.write(fileMagic, sizeof(fileMagic));
+        m_dataFile.flush();
+    }
+    m_dataSize = m_dataFile.size();
+    m_mapFile.setFileName(m_dataFile.fileName());
+    if (!m_mapFile.open(QIODevice::ReadOnly)) {
+        m_error = m_mapFile.errorString();
+        return false;
+    }
+    remap();
+    if (!m_map || memcmp(m_map, fileMagic, sizeof(fileMagic))) {
+        m_error = QObject::tr("%1 is not a time series file").arg(m_dataFile.fileName());
+        return false;
+    }
+
+    // index the blocks; a bad one can only be the last, torn by a crash
+    qint64 offset = sizeof(fileMagic);
+    while (offset < m_dataSize) {
+        const uchar *h = m_map + offset;
+        const quint32 bytes = offset + blockHeaderSize <= m_dataSize ? qFromLittleEndian<quint32>(h + 12) : 0;
+        if (offset + blockHeaderSize > m_dataSize || qFromLittleEndian<quint32>(h) != blockMagic
+                || offset + blockHeaderSize + bytes > m_dataSize
+                || Spool::crc32(reinterpret_cast<const char *>(h + blockHeaderSize), int(bytes))
+                        != qFromLittleEndian<quint32>(h + 48)) {
+            qWarning() << "cutting off a damaged block at" << offset << "in" << m_dataFile.fileName();
+            m_dataFile.resize(offset);
+            m_dataSize = offset;
+            break;
+        }
+        const quint32 id = qFromLittleEndian<quint32>(h + 4);
+        BlockInfo block;
+        block.offset = offset + blockHeaderSize;
+        block.bytes = bytes;
+        block.count = qFromLittleEndian<quint32>(h + 8);
+        block.first = qFromLittleEndian<qint64>(h + 16);
+        block.last = qFromLittleEndian<qint64>(h + 24);
+        quint64 bits = qFromLittleEndian<quint64>(h + 32);
+        memcpy(&block.min, &bits, sizeof(bits));
+        bits = qFromLittleEndian<quint64>(h + 40);
+        memcpy(&block.max, &bits, sizeof(bits));
+        if (id < quint32(m_seriesById.count()))
+            m_seriesById.at(int(id))->blocks.append(block);
+        m_points += block.count;
+        offset = block.offset + bytes;
+    }
+    m_dataFile.seek(m_dataSize);
+    loadHeads();
+    return true;
+}
+
+/*!
+    Restores the unfinished blocks that flush() saved.  A series that got
+    a block after that (its head filled up) has those points in the block
+    already, so its saved head is left out.
+*/
+void TimeSeriesStore::loadHeads()
+{
+    QFile file(m_directory + QLatin1String("/heads"));
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+    QDataStream in(&file);
+    quint32 magic = 0;
+    qint64 dataSize = 0;
+    quint32 n = 0;
+    in >> magic >> dataSize >> n;
+    if (magic != headsMagic) {
+        qWarning() << "ignoring" << file.fileName() << ": not a heads file";
+        return;
+    }
+    QVector<Point> points;
+    for (quint32 i = 0; i < n && in.status() == QDataStream::Ok; ++i) {
+        quint32 id, count;
+        QByteArray data;
+        in >> id >> count >> data;
+        if (in.status() != QDataStream::Ok || id >= quint32(m_seriesById.count()))
+            break;
+        Series *s = m_seriesById.at(int(id));
+        if (s->head || (!s->blocks.isEmpty() && s->blocks.last().offset - blockHeaderSize >= dataSize))
+            continue;
+        points.resize(0);
+        decode(reinterpret_cast<const uchar *>(data.constData()), quint32(data.size()), count,
+               std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max(), &points);
+        s->head = new Encoder;
+        for (const Point &p : points)
+            s->head->append(p.time, p.value);
+        m_points += s->head->count;
+    }
+}
+
+bool TimeSeriesStore::saveHeads()
+{
+    QSaveFile file(m_directory + QLatin1String("/heads"));
+    if (!file.open(QIODevice::WriteOnly)) {
+        m_error = file.errorString();
+        return false;
+    }
+    QVector<const Series *> heads;
+    for (const Series *s : m_seriesById)
+        if (s->head && s->head->count)
+            heads.append(s);
+    QDataStream out(&file);
+    out << headsMagic << m_dataSize << quint32(heads.count());
+    for (const Series *s : heads)
+        out << s->id << s->head->count << s->head->data;
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        m_error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+TimeSeriesStore::Series *TimeSeriesStore::series(const QString &name)
+{
+    if (Series *s = m_series.value(name))
+        return s;
+    QString clean = name;
+    clean.replace(QLatin1Char('\n'), QLatin1Char(' '));
+    if (m_seriesFile.write(clean.toUtf8() + '\n') < 0 || !m_seriesFile.flush()) {
+        m_error = m_seriesFile.errorString();
+        return nullptr;
+    }
+    Series *s = new Series;
+    s->id = quint32(m_seriesById.count());
+    s->name = name;
+    m_seriesById.append(s);
+    m_series.insert(name, s);
+    return s;
+}
+
+bool TimeSeriesStore::append(const QString &name, qint64 time, double value)
+{
+    QMutexLocker lock(&m_mutex);
+    if (!m_dataFile.isOpen())
+        return false;
+    Series *s = series(name);
+    if (!s)
+        return false;
+    if (!s->head)
+        s->head = new Encoder;
+    s->head->append(time, value);
+    ++m_points;
+    return s->head->count < maxBlockPoints || seal(s);
+}
+
+bool TimeSeriesStore::seal(Series *s)
+{
+    Encoder *e = s->head;
+    if (!e || !e->count)
+        return true;
+    uchar h[blockHeaderSize];
+    qToLittleEndian<quint32>(blockMagic, h);
+    qToLittleEndian<quint32>(s->id, h + 4);
+    qToLittleEndian<quint32>(e->count, h + 8);
+    qToLittleEndian<quint32>(quint32(e->data.size()), h + 12);
+    qToLittleEndian<qint64>(e->first, h + 16);
+    qToLittleEndian<qint64>(e->last, h + 24);
+    quint64 bits;
+    memcpy(&bits, &e->min, sizeof(bits));
+    qToLittleEndian<quint64>(bits, h + 32);
+    memcpy(&bits, &e->max, sizeof(bits));
+    qToLittleEndian<quint64>(bits, h + 40);
+    qToLittleEndian<quint32>(Spool::crc32(e->data.constData(), e->data.size()), h + 48);
+
+    if (m_dataFile.write(reinterpret_cast<const char *>(h), blockHeaderSize) != blockHeaderSize
+            || m_dataFile.write(e->data) != e->data.size() || !m_dataFile.flush()) {
+        m_error = m_dataFile.errorString();
+        return false;
+    }
+    BlockInfo block;
+    block.offset = m_dataSize + blockHeaderSize;
+    block.bytes = quint32(e->data.size());
+    block.count = e->count;
+    block.first = e->first;
+    block.last = e->last;
+    block.min = e->min;
+    block.max = e->max;
+    s->blocks.append(block);
+    m_dataSize = block.offset + block.bytes;
+    e->clear();
+    return true;
+}
+
+/*!
+    Saves the partly filled blocks to a file of their own, to be picked up
+    again by open().  They stay open, so flushing often doesn't make for
+    more (smaller) blocks; only the points appended since the last flush
+    are lost in a crash.
+*/
+bool TimeSeriesStore::flush()
+{
+    QMutexLocker lock(&m_mutex);
+    if (!m_dataFile.isOpen())
+        return true;
+    return saveHeads();
+}
+
+void TimeSeriesStore::remap() const
+{
+    if (m_map && m_mappedSize == m_dataSize)
+        return;
+    if (m_map)
+        m_mapFile.unmap(const_cast<uchar *>(m_map));
+    m_map = m_mapFile.map(0, m_dataSize);
+    m_mappedSize = m_map ? m_dataSize : 0;
+}
+
+QStringList TimeSeriesStore::seriesNames() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_series.keys();
+}
+
+/*!
+    Returns the points of \a series from \a from to \a to inclusive
+    (milliseconds since the epoch), in the order they were appended.
+*/
+QVector<TimeSeriesStore::Point> TimeSeriesStore::query(const QString &series, qint64 from, qint64 to) const
+{
+    QMutexLocker lock(&m_mutex);
+    QVector<Point> ret;
+    const Series *s = m_series.value(series);
+    if (!s)
+        return ret;
+    remap();
+    for (const BlockInfo &block : s->blocks) {
+        if (block.last < from || block.first > to || !m_map)
+            continue;
+        decode(m_map + block.offset, block.bytes, block.count, from, to, &ret);
+    }
+    if (s->head && s->head->count && s->head->last >= from && s->head->first <= to)
+        decode(reinterpret_cast<const uchar *>(s->head->data.constData()), quint32(s->head->data.size()),
+               s->head->count, from, to, &ret);
+    if (!std::is_sorted(ret.cbegin(), ret.cend(), [](const Point &a, const Point &b) { return a.time < b.time; }))
+        std::stable_sort(ret.begin(), ret.end(), [](const Point &a, const Point &b) { return a.time < b.time; });
+    return ret;
+}
+
+/*!
+    Returns the range of the values of \a series in each of \a count
+    consecutive intervals, each \a interval ms long, starting at \a from:
+    enough to draw it one interval per pixel.  A block that fits within
+    one interval isn't decoded at all: its range comes from its header,
+    and it counts as falling in the interval containing its midpoint, which
+    is close enough at that scale.  So the cost depends on the number of
+    intervals much more than on the number of points, however long the
+    time range.
+*/
+QVector<TimeSeriesStore::Bucket> TimeSeriesStore::envelope(const QString &series, qint64 from, qint64 interval,
+                                                           int count) const
+{
+    QVector<Bucket> ret(qMax(0, count));
+    if (count <= 0 || interval <= 0)
+        return ret;
+    const qint64 to = from + interval * count - 1;
+    auto add = [&](qint64 time, double min, double max, quint32 n) {
+        Bucket &b = ret[int(qBound(qint64(0), (time - from) / interval, qint64(count - 1)))];
+        if (!b.count) {
+            b.min = min;
+            b.max = max;
+        } else {
+            b.min = qMin(b.min, min);
+            b.max = qMax(b.max, max);
+        }
+        b.count += n;
+    };
+
+    QMutexLocker lock(&m_mutex);
+    const Series *s = m_series.value(series);
+    if (!s)
+        return ret;
+    remap();
+    QVector<Point> points;
+    for (const BlockInfo &block : s->blocks) {
+        if (block.last < from || block.first > to || !m_map)
+            continue;
+        if (block.first >= from && block.last <= to && block.last - block.first < interval) {
+            add(block.first + (block.last - block.first) / 2, block.min, block.max, block.count);
+            continue;
+        }
+        points.resize(0);
+        decode(m_map + block.offset, block.bytes, block.count, from, to, &points);
+        for (const Point &p : points)
+            add(p.time, p.value, p.value, 1);
+    }
+    if (s->head && s->head->count && s->head->last >= from && s->head->first <= to) {
+        points.resize(0);
+        decode(reinterpret_cast<const uchar *>(s->head->data.constData()), quint32(s->head->data.size()),
+               s->head->count, from, to, &points);
+        for (const Point &p : points)
+            add(p.time, p.value, p.value, 1);
+    }
+    return ret;
+}
+
+QString TimeSeriesStore::statistics() const
+{
+    QMutexLocker lock(&m_mutex);
+    int blocks = 0;
+    for (const Series *s : m_seriesById)
+        blocks += s->blocks.count();
+    return QObject::tr("history: %1 series, %2 points in %3 blocks, %4 bytes (%5 bytes per point)")
+            .arg(m_series.count()).arg(m_points).arg(blocks).arg(m_dataSize)
+            .arg(m_points ? double(m_dataSize) / m_points : 0, 0, 'f', 2);
+}
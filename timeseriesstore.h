@@ -0,0 +1,118 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef TIMESERIESSTORE_H
+#define TIMESERIESSTORE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QVector>
+
+/*
+    A small embedded store for numeric time series, compressed the way
+    Facebook's Gorilla does it: timestamps as deltas of deltas and values
+    as the XOR with the previous value, both in variable-length bit fields.
+    Regularly spaced, slowly changing sensor readings take a bit or two per
+    timestamp and a few bits per value.
+
+    Points are collected in an in-memory block per series; a full block
+    (1024 points) is appended to a single data file, with a header giving
+    its series, time range, value range and checksum.  flush() saves the
+    unfinished blocks to a separate file, replaced each time, from which
+    they're restored on open(), so they go on filling up across restarts.
+    The data file is memory-mapped for reading, and blocks outside the
+    requested time range are skipped without being decoded.  A torn block
+    at the end (from a crash) is cut off when the store is opened.
+    Points should be appended in time order, since that's what compresses
+    well, but they don't have to be: a block's time range is its earliest
+    and latest point, and query() sorts what it returns if necessary.
+
+    All the public functions may be called from any thread.
+*/
+class TimeSeriesStore
+{
+public:
+    struct Point {
+        qint64 time;    // milliseconds since the epoch
+        double value;
+    };
+
+    // the range of the values that fell into one interval of an envelope()
+    struct Bucket {
+        quint32 count = 0;
+        double min = 0;
+        double max = 0;
+    };
+
+    explicit TimeSeriesStore(const QString &directory);
+    ~TimeSeriesStore();
+
+    bool open();
+    QString errorString() const { return m_error; }
+
+    bool append(const QString &series, qint64 time, double value);
+    bool flush();
+
+    QStringList seriesNames() const;
+    QVector<Point> query(const QString &series, qint64 from, qint64 to) const;
+    QVector<Bucket> envelope(const QString &series, qint64 from, qint64 interval, int count) const;
+    QString statistics() const;
+
+private:
+    class Encoder;
+    struct BlockInfo {
+        qint64 offset;      // of the payload in the data file
+        quint32 bytes;
+        quint32 count;
+        qint64 first;       // earliest time, not necessarily the first appended
+        qint64 last;        // latest
+        double min;
+        double max;
+    };
+    struct Series {
+        quint32 id;
+        QString name;
+        QVector<BlockInfo> blocks;
+        Encoder *head = nullptr;
+    };
+
+    Series *series(const QString &name);
+    bool seal(Series *s);
+    void loadHeads();
+    bool saveHeads();
+    void remap() const;
+    static void decode(const uchar *data, quint32 bytes, quint32 count, qint64 from, qint64 to, QVector<Point> *out);
+
+private:
+    QString m_directory;
+    QFile m_dataFile;
+    QFile m_seriesFile;
+    mutable QFile m_mapFile;
+    mutable const uchar *m_map = nullptr;
+    mutable qint64 m_mappedSize = 0;
+    qint64 m_dataSize = 0;
+    QHash<QString, Series *> m_series;
+    QVector<Series *> m_seriesById;
+    quint64 m_points = 0;
+    QString m_error;
+    mutable QMutex m_mutex;
+};
+
+#endif // TIMESERIESSTORE_H
@@ -16,84 +16,302 @@
 ****************************************************************************/
 
 #include "trayble.h"
+#include "devicedriver.h"
+#include "devicesession.h"
+#include "framedecoder.h"
+#include "reading.h"
+#include "csvsink.h"
+#include "decodestage.h"
+#include "historysink.h"
+#include "influxsink.h"
+#include "resourceusage.h"
+#include "rollupstage.h"
+#include "rrdsink.h"
+#include "scanscheduler.h"
+#include "sinkpipeline.h"
+#include "streamprotocol.h"
+#include "streamsink.h"
+#include "timeseriesstore.h"
+#include <QDataStream>
 #include <QDebug>
-#include <QInputDialog>
+#include <QDir>
+#include <QFileInfo>
+#include <QLoggingCategory>
 #include <QMetaEnum>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
 
-static const QStringList supportedDeviceNamePrefixes = { "Electronic Scale", "aplant" };
+// status updates are frequent (every plant update); off unless
+// QT_LOGGING_RULES="trayble.status.debug=true"
+Q_LOGGING_CATEGORY(lcStatus, "trayble.status", QtInfoMsg)
+
+// per plant sensor, while waiting to be told which plant it is
+static const int maxPendingReadings = 1000;
+static const quint32 pendingMagic = 0x49504254; // "TBPI"
+static const quint32 pendingVersion = 1;
 
 TrayBle::TrayBle() :
-    m_influxHealthInsertReq(QUrl("http://localhost:8086/write?db=health")),
-    m_influxPlantsInsertReq(QUrl("http://localhost:8086/write?db=weather"))
+    m_gattCache(m_settings),
+    m_profiles(m_settings)
 {
+    m_profiles.load();
+    m_lastUser = m_profiles.lastUser();
     m_settings.beginGroup(QLatin1String("General"));
-    m_lastUser = m_settings.value(QLatin1String("lastUser")).toString();
-    m_settings.endGroup();
+    m_maxSessions = qMax(1, m_settings.value(QLatin1String("maxConnections"), m_maxSessions).toInt());
+    m_sessionTimeout = m_settings.value(QLatin1String("sessionTimeout"), m_sessionTimeout / 1000).toInt() * 1000;
+    m_advertCache.setHeartbeat(m_settings.value(QLatin1String("advertHeartbeat"), 300).toInt());
 
     m_discoveryAgent = new QBluetoothDeviceDiscoveryAgent(this);
-    m_discoveryAgent->setLowEnergyDiscoveryTimeout(0); // scan forever
-    m_influxHealthInsertReq.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
-    m_influxPlantsInsertReq.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+    m_discoveryAgent->setLowEnergyDiscoveryTimeout(0); // the scheduler decides when to stop
+    m_scanScheduler = new ScanScheduler(m_discoveryAgent, this);
+    // scan windows in seconds; the default window of 0 means scanning all the time
+    m_scanScheduler->setWindow(m_settings.value(QLatin1String("scanWindow"), 0).toInt() * 1000);
+    m_scanScheduler->setPeriod(m_settings.value(QLatin1String("scanPeriod"), 60).toInt() * 1000);
+    m_scanScheduler->setBoostDuration(m_settings.value(QLatin1String("scanBoost"), 120).toInt() * 1000);
+
+    m_settings.endGroup();
+
+    // plant sensors report far more often than anyone needs; keep summaries
+    RollupStage *rollup = new RollupStage;
+    m_settings.beginGroup(QLatin1String("Rollup"));
+    rollup->setMeasurements(m_settings.value(QLatin1String("measurements"), QStringList() << QLatin1String("plants")).toStringList());
+    QVector<int> windows;
+    for (const QString &w : m_settings.value(QLatin1String("windows"), QStringList() << QLatin1String("60")
+                                             << QLatin1String("900") << QLatin1String("3600")).toStringList())
+        if (w.toInt() > 0)
+            windows << w.toInt();
+    rollup->setWindows(windows);
+    rollup->setDeadband(FrameDecoder::Temperature, m_settings.value(QLatin1String("deadband/temperature"), 2).toReal());
+    rollup->setDeadband(FrameDecoder::Moisture, m_settings.value(QLatin1String("deadband/moisture"), 5).toReal());
+    m_settings.endGroup();
+    m_settings.beginGroup(QLatin1String("General"));
+
+    // where readings go
+    m_pipeline = new SinkPipeline(this);
+    m_pipeline->setMaxBacklog(m_settings.value(QLatin1String("sinkBacklog"), 10000).toInt());
+    // both run on the decoding thread, which is then the only one delivering
+    connect(rollup, &RollupStage::output, m_pipeline, &SinkPipeline::deliver, Qt::DirectConnection);
+    const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    m_pendingFileName = dataDir + QLatin1String("/pending");
+    const QStringList sinks = m_settings.value(QLatin1String("sinks"),
+            QStringList() << QLatin1String("influx") << QLatin1String("history")).toStringList();
+    if (sinks.contains(QLatin1String("influx"))) {
+        InfluxSink::WriterOptions options;
+        options.maxQueueLines = m_settings.value(QLatin1String("influxQueueLines"), 10000).toInt();
+        options.maxBatchLines = m_settings.value(QLatin1String("influxBatchLines"), 500).toInt();
+        options.flushInterval = m_settings.value(QLatin1String("influxFlushInterval"), 1000).toInt();
+        options.maxInFlight = m_settings.value(QLatin1String("influxMaxInFlight"), 2).toInt();
+        // keep readings on disk until the database has them
+        if (m_settings.value(QLatin1String("spool"), true).toBool())
+            options.spoolDirectory = dataDir + QLatin1String("/spool");
+        InfluxSink *influx = new InfluxSink(options);
+        m_settings.endGroup();
+        influx->configure(m_settings);
+        m_settings.beginGroup(QLatin1String("General"));
+        connect(influx, &InfluxSink::stored, this, [this](const QStringList &devices) {
+            for (const QString &device : devices)
+                m_latency.mark(device, LatencyTracker::Stored);
+        });
+        addSink(influx);
+    }
+    if (sinks.contains(QLatin1String("history"))) {
+        m_history.reset(new TimeSeriesStore(dataDir + QLatin1String("/history")));
+        if (m_history->open()) {
+            addSink(new HistorySink(m_history.data(),
+                                    m_settings.value(QLatin1String("historyFlushInterval"), 60).toInt() * 60000));
+        } else {
+            setStatus(tr("can't keep history: %1").arg(m_history->errorString()));
+            m_history.reset();
+        }
+    }
+    if (sinks.contains(QLatin1String("csv")))
+        addSink(new CsvSink(m_settings.value(QLatin1String("csvDirectory"), dataDir + QLatin1String("/csv")).toString()));
+    if (sinks.contains(QLatin1String("rrd")))
+        addSink(new RrdSink(m_settings.value(QLatin1String("rrdDirectory"), dataDir + QLatin1String("/rrd")).toString(),
+                            m_settings.value(QLatin1String("rrdStep"), 300).toInt()));
+
+    // who's who, from their history if we have it, otherwise from the last weight
+    m_userIndex.setMaxDistance(m_settings.value(QLatin1String("identifyDistance"), 3).toReal());
+    m_minIdentifyConfidence = m_settings.value(QLatin1String("identifyConfidence"), 0.6).toReal();
+    m_settings.endGroup();
+    if (m_history)
+        m_userIndex.load(*m_history);
+    for (const QString &user : m_profiles.userNames()) {
+        const qreal lastWeight = m_profiles.user(user).lastWeight;
+        if (m_userIndex.sampleCount(user) || lastWeight <= 0)
+            continue;
+        FrameDecoder::Values weight;
+        weight.value[FrameDecoder::Weight] = lastWeight;
+        weight.present = 1u << FrameDecoder::Weight;
+        m_userIndex.add(user, weight);
+    }
+
+    m_settings.beginGroup(QLatin1String("General"));
+    m_decode = new DecodeStage(rollup, m_settings.value(QLatin1String("decodeQueue"), 4096).toInt());
+    m_settings.endGroup();
+
+    // live readings for local programs, before the rollup
+    m_live = new SinkPipeline(this);
+    m_settings.beginGroup(QLatin1String("Stream"));
+    if (m_settings.value(QLatin1String("enabled"), false).toBool()) {
+        const QString runtimeDir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+        m_live->setMaxBacklog(m_settings.value(QLatin1String("backlog"), 10000).toInt());
+        StreamSink *stream = new StreamSink(
+                m_settings.value(QLatin1String("socket"), runtimeDir + QLatin1String("/trayble.sock")).toString(),
+                m_settings.value(QLatin1String("ring"), runtimeDir + QLatin1String("/trayble-readings.ring")).toString(),
+                m_settings.value(QLatin1String("ringSlots"), 4096).toInt(),
+                m_settings.value(QLatin1String("ringSlotSize"), 256).toInt());
+        connect(stream, &ReadingSink::error, this, &TrayBle::setStatus);
+        m_live->addSink(stream);
+        m_decode->setLivePipeline(m_live);
+    }
+    m_settings.endGroup();
+    connect(m_decode, &DecodeStage::updated, this, &TrayBle::showPlantReading);
+    m_decode->start();
 
     connect(m_discoveryAgent, SIGNAL(deviceDiscovered(const QBluetoothDeviceInfo&)),
             this, SLOT(addDevice(const QBluetoothDeviceInfo&)));
+    connect(m_discoveryAgent, SIGNAL(deviceUpdated(const QBluetoothDeviceInfo&, QBluetoothDeviceInfo::Fields)),
+            this, SLOT(updateDevice(const QBluetoothDeviceInfo&, QBluetoothDeviceInfo::Fields)));
     connect(m_discoveryAgent, SIGNAL(error(QBluetoothDeviceDiscoveryAgent::Error)),
             this, SLOT(deviceScanError(QBluetoothDeviceDiscoveryAgent::Error)));
     connect(m_discoveryAgent, SIGNAL(finished()), this, SLOT(scanFinished()));
+
+    // once the event loop runs, so that identificationRequested() is connected by then
+    QMetaObject::invokeMethod(this, "restorePending", Qt::QueuedConnection);
 }
 
 TrayBle::~TrayBle()
 {
+    savePending();
+    // finish decoding and close the rollup windows before the sinks go
+    m_decode->stop();
+    m_live->shutdown();
+    m_pipeline->shutdown();
+}
+
+void TrayBle::addSink(ReadingSink *sink)
+{
+    connect(sink, &ReadingSink::error, this, &TrayBle::setStatus);
+    m_pipeline->addSink(sink);
 }
 
 void TrayBle::deviceSearch()
 {
-    m_discoveryAgent->start();
+    m_scanScheduler->start();
     setStatus(tr("scanning for devices"));
 }
 
 void TrayBle::scanFinished()
 {
+    if (!m_scanScheduler->isScanning())
+        return;
     setStatus(tr("scanning stopped unexpectedly"));
     deviceSearch();
 }
 
+QString TrayBle::scanStatistics() const
+{
+    return m_scanScheduler->statistics();
+}
+
+QString TrayBle::statistics() const
+{
+    return m_latency.summary() + QLatin1Char('\n') + scanStatistics() + QLatin1Char('\n')
+            + m_decode->statistics() + QLatin1Char('\n') + m_pipeline->statistics() + QLatin1Char('\n')
+            + (m_live->sinks().isEmpty() ? QString() : m_live->statistics() + QLatin1Char('\n'))
+            + tr("%n identification(s) pending", nullptr, m_pendingIdentifications.count()) + QLatin1Char('\n')
+            + ResourceUsage::summary();
+}
+
+bool TrayBle::saveStatistics(const QString &fileName)
+{
+    return m_latency.dump(fileName);
+}
+
 void TrayBle::addDevice(const QBluetoothDeviceInfo &device)
 {
     QString addrString = device.address().toString();
     if (m_discoveredDevices.contains(addrString)) {
-        qDebug() << "rediscovered" << device.name() << device.address();
+        // each scan window restarts the agent, which reports known devices again
+        updateDevice(device, QBluetoothDeviceInfo::Field::All);
         return;
     }
     if (device.coreConfigurations() & QBluetoothDeviceInfo::LowEnergyCoreConfiguration) {
         qDebug() << "discovered device " << device.name() << device.address().toString()
                  << "manufacturer IDs" << hex << device.manufacturerIds();
-        for (const QString &pfx : supportedDeviceNamePrefixes) {
-            if (device.name().startsWith(pfx)) {
-                m_discoveredDevices.insert(addrString);
-                updateDevice(device, QBluetoothDeviceInfo::Field::All);
-                //updateDevice(device, QBluetoothDeviceInfo::Field(0x7fff));
-                connectService(device);
-                connect(m_discoveryAgent, SIGNAL(deviceUpdated(const QBluetoothDeviceInfo&, QBluetoothDeviceInfo::Fields)),
-                        this, SLOT(updateDevice(const QBluetoothDeviceInfo&, QBluetoothDeviceInfo::Fields)));
-            }
+        if (const DeviceDriver *driver = DriverRegistry::instance().match(device)) {
+            m_discoveredDevices.insert(addrString, driver);
+            updateDevice(device, QBluetoothDeviceInfo::Field::All);
         }
     }
 }
 
 void TrayBle::updateDevice(const QBluetoothDeviceInfo &device, QBluetoothDeviceInfo::Fields updatedFields)
 {
-    if (updatedFields.testFlag(QBluetoothDeviceInfo::Field::ManufacturerData))
-        for (auto id : device.manufacturerIds()) {
-            qDebug() << device.name() << device.address() << hex << "ID" << id << "data" << dec << device.manufacturerData(id).count() << hex << "bytes:" << device.manufacturerData(id).toHex();
-            if (id == 0x4c)
-                decodeIBeaconData(device, device.manufacturerData(id));
+    const DeviceDriver *driver = m_discoveredDevices.value(device.address().toString());
+    if (!driver)
+        return;
+    const qint64 timestamp = Reading::now();
+
+    if (driver->advertLayout && updatedFields.testFlag(QBluetoothDeviceInfo::Field::ManufacturerData)) {
+        const QByteArray data = device.manufacturerData(driver->advertManufacturerId);
+        // drop repeats of the same payload before doing anything else with them
+        if (!data.isEmpty() && m_advertCache.isNew(device.address(), driver->advertManufacturerId, data)) {
+            qDebug() << device.name() << device.address() << hex << "ID" << driver->advertManufacturerId
+                     << "data" << dec << data.count() << hex << "bytes:" << data.toHex();
+            decodeAdvertisement(device, driver, data, timestamp);
         }
+    }
 
-    if (device.name() == supportedDeviceNamePrefixes.first()) // Electronic Scale
+    if (driver->kind == DeviceDriver::Scale)
+        m_scanScheduler->boost(); // a measurement is probably about to happen
+    if (driver->connectable && !m_replaying)
         connectService(device);
 }
 
+/*!
+    Feeds an advert from a capture file through the same path as one from
+    the discovery agent.
+*/
+void TrayBle::replayAdvertisement(const QBluetoothDeviceInfo &device, QBluetoothDeviceInfo::Fields updatedFields)
+{
+    if (m_discoveredDevices.contains(device.address().toString()))
+        updateDevice(device, updatedFields);
+    else
+        addDevice(device);
+}
+
+/*!
+    A connection in a capture file starts over, like a new DeviceSession.
+*/
+void TrayBle::replayConnected(const QBluetoothAddress &address)
+{
+    m_replayedReadings.remove(address.toUInt64());
+}
+
+/*!
+    Feeds a GATT notification from a capture file through the same decoding
+    as one from a DeviceSession, and like a session, takes only the first
+    complete reading per connection; the scale keeps notifying while it
+    settles.  There is no session, so the scale can't be told to switch
+    users.
+*/
+void TrayBle::replayNotification(const QBluetoothAddress &address, quint16 handle, const QByteArray &value)
+{
+    Q_UNUSED(handle)
+    const DeviceDriver *driver = m_discoveredDevices.value(address.toString());
+    if (!driver || !driver->notificationLayout || m_replayedReadings.contains(address.toUInt64()))
+        return;
+    FrameDecoder::Values values;
+    if (value.size() != driver->notificationLayout->length
+            || !FrameDecoder::decode(*driver->notificationLayout, value, &values))
+        return;
+    m_replayedReadings.insert(address.toUInt64());
+    updateBodyComp(nullptr, values, Reading::now());
+}
+
 void TrayBle::deviceScanError(QBluetoothDeviceDiscoveryAgent::Error e)
 {
     static QMetaEnum menum = m_discoveryAgent->metaObject()->enumerator(
@@ -116,7 +334,7 @@ void TrayBle::deviceScanError(QBluetoothDeviceDiscoveryAgent::Error e)
 
 void TrayBle::setStatus(QString s)
 {
-    qDebug() << s;
+    qCDebug(lcStatus) << s;
     m_status = s;
     emit statusChanged(m_status);
 }
@@ -128,376 +346,307 @@ QString TrayBle::status() const
 
 void TrayBle::connectService(const QBluetoothDeviceInfo &device)
 {
-    QLowEnergyController *ctrl = QLowEnergyController::createCentral(device, this);
-    m_connectedDevices.insert(device.address().toString(), DeviceInfo { device, ctrl });
-    connect(ctrl, SIGNAL(serviceDiscovered(QBluetoothUuid)),
-            this, SLOT(serviceDiscovered(QBluetoothUuid)));
-    connect(ctrl, SIGNAL(discoveryFinished()),
-            this, SLOT(serviceScanDone()));
-    connect(ctrl, SIGNAL(error(QLowEnergyController::Error)),
-            this, SLOT(controllerError(QLowEnergyController::Error)));
-    connect(ctrl, SIGNAL(connected()),
-            this, SLOT(deviceConnected()));
-    connect(ctrl, SIGNAL(disconnected()),
-            this, SLOT(deviceDisconnected()));
-
-    if (device.name() == supportedDeviceNamePrefixes.first()) // Electronic Scale
-        ctrl->connectToDevice();
-    else
-        ctrl->discoverServices();
-}
+    const QString addrString = device.address().toString();
+    if (m_sessions.contains(addrString))
+        return;
 
-void TrayBle::deviceConnected()
-{
-    QLowEnergyController *ctrl = static_cast<QLowEnergyController *>(sender());
-    qDebug() << ctrl->remoteName();
-    m_updatedBodyComp = false;
-    ctrl->discoverServices();
-}
+    for (const QBluetoothDeviceInfo &pending : m_pendingConnections)
+        if (pending.address() == device.address())
+            return;
+    m_latency.mark(addrString, LatencyTracker::Advertised);
 
-void TrayBle::deviceDisconnected()
-{
-    QLowEnergyController *ctrl = static_cast<QLowEnergyController *>(sender());
-    qDebug() << ctrl->remoteName() << ctrl->state();
-    setStatus(tr("%1 disconnected").arg(ctrl->remoteName()));
-    deviceSearch();
+    if (m_sessions.count() >= m_maxSessions)
+        m_pendingConnections.enqueue(device);
+    else
+        startSession(device);
 }
 
-void TrayBle::serviceDiscovered(const QBluetoothUuid &svc)
+void TrayBle::startSession(const QBluetoothDeviceInfo &device)
 {
-    QLowEnergyController *ctrl = static_cast<QLowEnergyController *>(sender());
-    qDebug() << ctrl->remoteName() << ": discovered service" << svc << hex << svc.toUInt16();
-    if (svc.toUInt16() == 0xfff0)
-        m_serviceUuid = svc;
+    const QString addrString = device.address().toString();
+    DeviceSession *session = new DeviceSession(device, m_discoveredDevices.value(addrString),
+                                               &m_gattCache, &m_latency, this);
+    session->setTimeout(m_sessionTimeout);
+    m_sessions.insert(addrString, session);
+    m_latency.mark(addrString, LatencyTracker::ConnectRequested);
+    connect(session, &DeviceSession::statusChanged, this, &TrayBle::setStatus);
+    connect(session, &DeviceSession::readingReceived, this, &TrayBle::updateBodyComp);
+    connect(session, &DeviceSession::finished, this, &TrayBle::sessionFinished);
+    session->connectToDevice(userCharacteristic(m_lastUser));
 }
 
-void TrayBle::serviceScanDone()
+void TrayBle::sessionFinished(DeviceSession *session)
 {
-    QLowEnergyController *ctrl = static_cast<QLowEnergyController *>(sender());
-    qDebug() << ctrl->remoteName();
-
-    delete m_service;
-    m_service = nullptr;
-
-    if (m_serviceUuid.isNull()) {
-        setStatus(tr("no known service on ") + ctrl->remoteName());
-        return;
-    }
-
-    setStatus(tr("connecting..."));
-    m_service = ctrl->createServiceObject(m_serviceUuid, this);
-
-    if (!m_service) {
-        setStatus(tr("failed to connect to ") + ctrl->remoteName());
-        return;
-    }
-
-    connect(m_service, SIGNAL(stateChanged(QLowEnergyService::ServiceState)),
-            this, SLOT(serviceStateChanged(QLowEnergyService::ServiceState)));
-    connect(m_service, SIGNAL(characteristicChanged(QLowEnergyCharacteristic,QByteArray)),
-            this, SLOT(updateBodyComp(QLowEnergyCharacteristic,QByteArray)));
-    connect(m_service, SIGNAL(error(QLowEnergyService::ServiceError)),
-            this, SLOT(serviceError(QLowEnergyService::ServiceError)));
-
-    m_service->discoverDetails();
+    m_sessions.remove(session->address());
+    session->deleteLater();
+    if (!m_pendingConnections.isEmpty())
+        startSession(m_pendingConnections.dequeue());
+    deviceSearch();
 }
 
-void TrayBle::disconnectService()
+QByteArray TrayBle::userCharacteristic(const QString &user) const
 {
-    // disable notifications before disconnecting
-    if (m_notification.isValid() && m_service
-            && m_notification.value() == QByteArray::fromHex("0100")) {
-        m_service->writeDescriptor(m_notification, QByteArray::fromHex("0000"));
-    } else {
-//        m_controller->disconnectFromDevice(); // TODO
-        delete m_service;
-        m_service = nullptr;
-    }
+    const QByteArray ret = m_profiles.user(user).characteristic();
+    qDebug() << user << ret.toHex();
+    return ret;
 }
 
-QByteArray TrayBle::userCharacteristic(QString user)
+void TrayBle::decodeAdvertisement(const QBluetoothDeviceInfo &dev, const DeviceDriver *driver, const QByteArray &data,
+                                  qint64 timestamp)
 {
-    m_settings.beginGroup(QLatin1String("UserID"));
-    uint8_t id = m_settings.value(user, 99).toInt();
-    m_settings.endGroup();
-
-    m_settings.beginGroup(QLatin1String("UserGender"));
-    uint8_t gender = 0; // female
-    if (m_settings.value(user, "m") == "m")
-        gender = 1; // male
-    m_settings.endGroup();
-
-    m_settings.beginGroup(QLatin1String("UserExerciseLevel"));
-    uint8_t exerciseLevel = m_settings.value(user, 0).toInt();
-    m_settings.endGroup();
-
-    m_settings.beginGroup(QLatin1String("UserHeight"));
-    uint8_t height = m_settings.value(user, 170).toInt();
-    m_settings.endGroup();
-
-    m_settings.beginGroup(QLatin1String("UserBirthday"));
-    uint8_t age = int(m_settings.value(user, QDate(1990, 1, 1)).toDate().daysTo(QDate::currentDate()) / 365.25);
-    m_settings.endGroup();
-
-    m_settings.beginGroup(QLatin1String("UserUnits"));
-    uint8_t units = 1; // kg
-    QString unitsString = m_settings.value(user, 0).toString();
-    if (!unitsString.isEmpty()) {
-        switch (unitsString.at(0).toLatin1()) {
-        case 's':
-            units = 0;
-            break;
-        case 'p':
-            units = 2;
+    switch (driver->kind) {
+    case DeviceDriver::PlantSensor: {
+        DecodeStage::Frame frame;
+        frame.driver = driver;
+        frame.data = data;
+        frame.deviceName = dev.name();
+        Reading &reading = frame.reading;
+        reading.deviceType = QLatin1String("plant");
+        reading.measurement = QLatin1String("plants");
+        reading.tagKey = QLatin1String("plant");
+        reading.device = dev.address().toString();
+        reading.timestamp = timestamp;
+
+        // figure out which plant this is; if we know, the decoding thread does the rest
+        reading.tagValue = m_profiles.alias(dev.address(), dev.name());
+        if (!reading.tagValue.isEmpty()) {
+            m_decode->submit(frame);
             break;
         }
-    }
-    m_settings.endGroup();
-
-    uint8_t checksum = id ^ gender ^ exerciseLevel ^ height ^ age ^ units;
-
-    QByteArray ret;
-    ret.append(0xfe);
-    ret.append(id);
-    ret.append(gender);
-    ret.append(exerciseLevel);
-    ret.append(height);
-    ret.append(age);
-    ret.append(units);
-    ret.append(checksum);
-
-    qDebug() << user << id << gender << exerciseLevel << height << age << units << checksum << ret.toHex();
-
-    return ret;
-}
-
-void TrayBle::sendRequest()
-{
-    for (const QLowEnergyCharacteristic &characteristic : m_service->characteristics()) {
-        qDebug() << "   characteristic " << hex << characteristic.handle() << characteristic.name() << characteristic.properties();
-
-        switch (characteristic.properties()) {
-        case QLowEnergyCharacteristic::Write: {
-            // Send user preferences (even though we aren't sure which user this is, yet).
-            // Merely subscribing for notifications without writing to this characteristic
-            // seems not to be enough to get a weight reading.
-            m_service->writeCharacteristic(characteristic, userCharacteristic(m_lastUser));
-        } break;
-        case QLowEnergyCharacteristic::Notify: {
-            m_notification = characteristic.descriptor(QBluetoothUuid::ClientCharacteristicConfiguration);
-            if (!m_notification.isValid()) {
-                qWarning() << "invalid notification descriptor";
+        if (!FrameDecoder::decode(*driver->advertLayout, data, &reading.values))
+            return;
+        // keep its readings until someone says, but ask only once
+        for (auto it = m_pendingIdentifications.begin(); it != m_pendingIdentifications.end(); ++it) {
+            if (it->plant && it->address == dev.address()) {
+                if (it->readings.count() >= maxPendingReadings)
+                    it->readings.removeFirst();
+                it->readings.append(reading);
                 return;
             }
-
-            // enable notification
-            m_service->writeDescriptor(m_notification, QByteArray::fromHex("0100"));
-        }
-            break;
-        default:
-            break;
         }
-    }
-}
-
-void TrayBle::controllerError(QLowEnergyController::Error e)
-{
-    static QMetaEnum menum = static_cast<QLowEnergyController *>(sender())
-            ->metaObject()->enumerator(static_cast<QLowEnergyController *>(sender())
-                                       ->metaObject()->indexOfEnumerator("Error"));
-    setStatus(tr("controller error: %1").arg(menum.valueToKey(e)));
-}
-
-void TrayBle::serviceStateChanged(QLowEnergyService::ServiceState s)
-{
-    switch (s) {
-    case QLowEnergyService::ServiceDiscovered:
-        sendRequest();
-        break;
+        PendingIdentification pending;
+        pending.plant = true;
+        pending.address = dev.address();
+        pending.deviceName = dev.name();
+        pending.readings.append(reading);
+        requestIdentification(pending, tr("Which plant has sensor %1?").arg(dev.name()));
+    } break;
     default:
         break;
     }
 }
 
-void TrayBle::serviceError(QLowEnergyService::ServiceError e)
+void TrayBle::storePlantReading(const Reading &reading, const QString &deviceName)
 {
-    static QMetaEnum menum = static_cast<QLowEnergyService *>(sender())
-            ->metaObject()->enumerator(static_cast<QLowEnergyService *>(sender())
-                                       ->metaObject()->indexOfEnumerator("ServiceError"));
-    setStatus(tr("service error: %1").arg(menum.valueToKey(e)));
+    DecodeStage::Frame frame;
+    frame.deviceName = deviceName;
+    frame.reading = reading;
+    m_decode->submit(frame);
 }
 
-void TrayBle::decodeIBeaconData(const QBluetoothDeviceInfo &dev, QByteArray data)
+void TrayBle::showPlantReading(const Reading &reading, const QString &deviceName)
 {
-//qDebug() << dev.name() << dev.address() << data.toHex();
-    if (dev.name().startsWith("aplant") && data.length() == 23) { // TODO and some part of some UUID is well-known?
-        // figure out which plant this is
-        m_settings.beginGroup(QLatin1String("Plants"));
-        QStringList plants = m_settings.childKeys();
-        QString plantName;
-        for (const QString &key : m_settings.childKeys()) {
-            if (dev.name() == key)
-                plantName = m_settings.value(key).toString();
-        }
-        if (plantName.isEmpty()) {
-            plantName = QInputDialog::getText(nullptr, tr("Which plant has sensor %1?").arg(dev.name()), tr("plant name"));
-            m_settings.setValue(dev.name(), plantName);
-        }
-        m_settings.endGroup();
+    // TODO if there's a settable name on the device, we need that
+    int temperature = int(reading.values[FrameDecoder::Temperature]);
+    int moisture = int(reading.values[FrameDecoder::Moisture]);
+    QString message = tr("%1 (%2) temperature %3 moisture %4").arg(reading.tagValue).arg(deviceName).arg(temperature).arg(moisture);
+    QString values = tr("%1°C %2%").arg(temperature).arg(moisture);
+    emit readingUpdated(reading.tagValue, values);
+    setStatus(message);
+}
 
-        // TODO if there's a settable name on the device, we need that
-        int temperature = int(data[data.length() - 2]);
-        int moisture = int(data[data.length() - 3]);
-        QString message = tr("%1 (%2) temperature %3 moisture %4").arg(plantName).arg(dev.name()).arg(temperature).arg(moisture);
-        QString reading = tr("%1°C %2%").arg(temperature).arg(moisture);
-        emit readingUpdated(plantName, reading);
-        setStatus(message);
-
-        // update influxDB
-        if (!m_netReply) {
-            QString reqData = QLatin1String("plants,plant=%1 temperature=%2,moisture=%3");
-            reqData = reqData.arg(plantName).arg(temperature).arg(moisture);
-            m_netReply = m_nam.post(m_influxPlantsInsertReq, reqData.toLatin1());
-            connect(m_netReply, &QNetworkReply::finished, this, &TrayBle::networkFinished);
-            connect(m_netReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(networkError(QNetworkReply::NetworkError)));
-        }
+void TrayBle::updateBodyComp(DeviceSession *session, const FrameDecoder::Values &values, qint64 timestamp)
+{
+    Reading reading;
+    reading.deviceType = QLatin1String("scale");
+    reading.measurement = QLatin1String("bodycomp");
+    reading.tagKey = QLatin1String("username");
+    if (session)
+        reading.device = session->address();
+    reading.timestamp = timestamp;
+    reading.values = values;
+
+    // figure out which user this might be
+    const UserIndex::Match match = m_userIndex.identify(values);
+    qDebug() << "nearest user" << match.user << "distance" << match.distance << "confidence" << match.confidence;
+
+    if (!match.known || match.confidence < m_minIdentifyConfidence) {
+        // don't hold everything else up while waiting for an answer
+        PendingIdentification pending;
+        pending.suggestion = match.known ? match.user : QString();
+        pending.readings.append(reading);
+        requestIdentification(pending, tr("New user? %1 %2").arg(values[FrameDecoder::Weight]).arg(tr("kg")));
+        return;
     }
+    reading.tagValue = match.user;
+    storeBodyComp(reading);
 }
 
-void TrayBle::networkFinished()
+void TrayBle::storeBodyComp(const Reading &reading)
 {
-    qDebug() << "influxDB says: " << m_netReply->readAll();
-    m_netReply->disconnect();
-    m_netReply->deleteLater();
-    m_netReply = nullptr;
+    const FrameDecoder::Values &values = reading.values;
+    const qreal weight = values[FrameDecoder::Weight];
+    const qreal fat = values[FrameDecoder::Fat];
+    const qreal bone = values[FrameDecoder::Bone];
+    const qreal muscle = values[FrameDecoder::Muscle];
+    const qreal water = values[FrameDecoder::Water];
+    const int bmr = int(values[FrameDecoder::Bmr]);
+
+    const bool differentUser = reading.tagValue != m_lastUser;
+    m_lastUser = reading.tagValue;
+    m_userIndex.add(m_lastUser, values);
+
+    m_profiles.setLastWeight(m_lastUser, weight);
+    m_profiles.setLastUser(m_lastUser);
+
+    // update the UI
+    QString message = tr("%1 %2 (delta %8), %3% fat, %4% water, %5 %2 muscle, %6 %2 bone, BMR %7 kcal")
+            .arg(weight).arg(tr("kg")).arg(fat).arg(water).arg(muscle).arg(bone).arg(bmr).arg(m_lastUser);
+
+    // the notification is urgent, and takes the rest along with it
+    setStatus(message);
+    emit readingUpdated(m_lastUser, message);
+    emit notify(m_lastUser, message);
+
+    m_decode->submit(reading);
+
+    // if this is a different user than last time, ask the scale to use the user's settings and try again
+    DeviceSession *session = m_sessions.value(reading.device);
+    if (differentUser && session)
+        session->sendRequest(userCharacteristic(m_lastUser));
 }
 
-void TrayBle::networkError(QNetworkReply::NetworkError e)
+void TrayBle::requestIdentification(const PendingIdentification &pending, const QString &question)
 {
-    static QMetaEnum menum = m_netReply->metaObject()->enumerator(
-                m_netReply->metaObject()->indexOfEnumerator("NetworkError"));
-    setStatus(tr("network error: ") + menum.key(e));
-    m_netReply->disconnect();
-    m_netReply->deleteLater();
-    m_netReply = nullptr;
+    const quint64 id = m_nextIdentification++;
+    auto it = m_pendingIdentifications.insert(id, pending);
+    it->question = question;
+    savePending();
+    emit identificationRequested(id, question, pending.suggestion);
 }
 
-void TrayBle::updateBodyComp(const QLowEnergyCharacteristic &c,
-                                 const QByteArray &value)
+/*!
+    Writes the readings still waiting for identification to disk, so that
+    quitting before anyone answers (or running without anyone to ask, as
+    trayble-daemon does) doesn't lose them.
+*/
+void TrayBle::savePending() const
 {
-    if (m_updatedBodyComp)
+    if (m_pendingFileName.isEmpty() || m_replaying)
         return;
-    QByteArray hexValue = value.toHex();
-    qDebug() << c.name() << hexValue;
-
-    // example cf01adaa 0405 015a 1b 0269 13 01cd 0599
-    //         not sure, weight, fat, bone, muscle, visceral fat, water, BMR
-    if (hexValue.length() != 32)
-        setStatus(tr("reading has unexpected length"));
-    else {
-        // Decode values from the hex string
-        bool ok = false;
-        int val = hexValue.mid(8, 4).toInt(&ok, 16);
-        if (!ok) {
-            setStatus(tr("failed to decode weight reading "));
-            return;
-        }
-        m_weight = val / 10.0;
-
-        val = hexValue.mid(12, 4).toInt(&ok, 16);
-        if (!ok) {
-            setStatus(tr("failed to decode fat reading"));
-            return;
-        }
-        m_fat = val / 10.0;
-
-        val = hexValue.mid(16, 2).toInt(&ok, 16);
-        if (!ok) {
-            setStatus(tr("failed to decode bone mass reading"));
-            return;
-        }
-        m_bone = val / 10.0;
-
-        val = hexValue.mid(18, 4).toInt(&ok, 16);
-        if (!ok) {
-            setStatus(tr("failed to decode muscle mass reading"));
-            return;
-        }
-        m_muscle = val / 10.0;
-
-        val = hexValue.mid(22, 2).toInt(&ok, 16);
-        if (!ok) {
-            setStatus(tr("failed to decode visceral fat reading"));
-            return;
-        }
-        m_vfat = val / 10.0;
-
-        val = hexValue.mid(24, 4).toInt(&ok, 16);
-        if (!ok) {
-            setStatus(tr("failed to decode water reading"));
-            return;
+    if (m_pendingIdentifications.isEmpty()) {
+        QFile::remove(m_pendingFileName);
+        return;
+    }
+    QDir().mkpath(QFileInfo(m_pendingFileName).absolutePath());
+    QSaveFile file(m_pendingFileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "can't save unidentified readings:" << file.errorString();
+        return;
+    }
+    QDataStream out(&file);
+    out << pendingMagic << pendingVersion << quint32(m_pendingIdentifications.count());
+    QList<quint64> ids = m_pendingIdentifications.keys();
+    std::sort(ids.begin(), ids.end());
+    QByteArray data;
+    for (quint64 id : ids) {
+        const PendingIdentification &p = m_pendingIdentifications[id];
+        out << p.plant << quint64(p.address.toUInt64()) << p.deviceName << p.suggestion << p.question
+            << quint32(p.readings.count());
+        for (const Reading &reading : p.readings) {
+            data.resize(0);
+            StreamProtocol::appendReading(&data, reading);
+            out << data;
         }
-        m_water = val / 10.0;
+    }
+    if (!file.commit())
+        qWarning() << "can't save unidentified readings:" << file.errorString();
+}
 
-        val = hexValue.mid(28, 4).toInt(&ok, 16);
-        if (!ok) {
-            setStatus(tr("failed to decode BMR reading"));
-            return;
-        }
-        m_bmr = val;
-        m_updatedBodyComp = true;
-
-        // figure out which user this might be
-        m_settings.beginGroup(QLatin1String("UserWeights"));
-        QStringList users = m_settings.childKeys();
-        QString nearestUser;
-        qreal nearestUserDelta = 1000;
-        for (const QString &key : users) {
-            qreal weight = m_settings.value(key).toReal();
-            qreal delta = weight - m_weight;
-            if (qAbs(delta) < qAbs(nearestUserDelta)) {
-                nearestUser = key;
-                nearestUserDelta = delta;
-            }
+/*!
+    Takes up the readings left unidentified last time: those that can now
+    be identified (a plant alias or a user added to the settings meanwhile)
+    are stored, and for the rest the question is asked again.
+*/
+void TrayBle::restorePending()
+{
+    if (m_replaying) // a replay is self-contained
+        return;
+    QFile file(m_pendingFileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+    QDataStream in(&file);
+    quint32 magic = 0, version = 0, count = 0;
+    in >> magic >> version >> count;
+    if (magic != pendingMagic || version != pendingVersion) {
+        qWarning() << "ignoring" << m_pendingFileName << ": unknown format";
+        return;
+    }
+    QVector<PendingIdentification> restored;
+    QByteArray data;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        PendingIdentification p;
+        quint64 address = 0;
+        quint32 readings = 0;
+        in >> p.plant >> address >> p.deviceName >> p.suggestion >> p.question >> readings;
+        p.address = QBluetoothAddress(address);
+        for (quint32 r = 0; r < readings && in.status() == QDataStream::Ok; ++r) {
+            in >> data;
+            Reading reading;
+            if (StreamProtocol::readReading(data.constData(), data.size(), &reading))
+                p.readings.append(reading);
         }
+        if (!p.readings.isEmpty())
+            restored.append(p);
+    }
+    file.close();
 
-        bool differentUser = true;
-        if (nearestUser.isEmpty() || nearestUserDelta > 5) {
-            m_lastUser = QInputDialog::getText(nullptr, tr("New user?"), tr("user name"));
+    for (const PendingIdentification &p : restored) {
+        QString name;
+        PendingIdentification pending = p;
+        if (p.plant) {
+            name = m_profiles.alias(p.address, p.deviceName);
         } else {
-            if (m_lastUser == nearestUser)
-                differentUser = false;
-            else
-                m_lastUser = nearestUser;
-        }
-
-        // update user's last-known weight for comparison next time
-        m_settings.setValue(m_lastUser, m_weight);
-        m_settings.endGroup();
-
-        m_settings.beginGroup(QLatin1String("General"));
-        m_settings.setValue(QLatin1String("lastUser"), m_lastUser);
-        m_settings.endGroup();
-
-        // update the UI
-        QString message = tr("%1 %2 (delta %8), %3% fat, %4% water, %5 %2 muscle, %6 %2 bone, BMR %7 kcal")
-                .arg(m_weight).arg(tr("kg")).arg(m_fat).arg(m_water).arg(m_muscle).arg(m_bone).arg(m_bmr).arg(m_lastUser);
-
-        setStatus(message);
-        emit notify(m_lastUser, message);
-        emit readingUpdated(m_lastUser, message);
-
-        // update influxDB
-        if (!m_netReply) {
-            QString reqData = QLatin1String("bodycomp,username=%1 weight=%2,unit=\"%3\",fat=%4,water=%5,muscle=%6,bone=%7,bmr=%8,vfat=%9");
-            reqData = reqData.arg(m_lastUser).arg(m_weight).arg(tr("kg")).arg(m_fat).arg(m_water).arg(m_muscle).arg(m_bone).arg(m_bmr).arg(m_vfat);
-            m_netReply = m_nam.post(m_influxHealthInsertReq, reqData.toLatin1());
-            connect(m_netReply, &QNetworkReply::finished, this, &TrayBle::networkFinished);
-            connect(m_netReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(networkError(QNetworkReply::NetworkError)));
+            const UserIndex::Match match = m_userIndex.identify(p.readings.first().values);
+            if (match.known && match.confidence >= m_minIdentifyConfidence)
+                name = match.user;
+            else if (match.known)
+                pending.suggestion = match.user;
         }
+        const quint64 id = m_nextIdentification++;
+        m_pendingIdentifications.insert(id, pending);
+        if (name.isEmpty())
+            emit identificationRequested(id, pending.question, pending.suggestion);
+        else
+            identify(id, name);
+    }
+    savePending();
+    if (!restored.isEmpty())
+        setStatus(tr("%n unidentified reading(s) from last time", nullptr, restored.count()));
+}
 
-        // if this is a different user than last time, ask the scale to use the user's settings and try again
-        if (differentUser)
-            sendRequest();
+/*!
+    Attributes the readings waiting on identification \a request to
+    \a name and sends them on their way; if \a name is empty, nobody
+    knows, and they are dropped.
+*/
+void TrayBle::identify(quint64 request, const QString &name)
+{
+    const PendingIdentification pending = m_pendingIdentifications.take(request);
+    if (pending.readings.isEmpty())
+        return;
+    savePending();
+    if (name.isEmpty()) {
+        setStatus(tr("dropped %n unidentified reading(s)", nullptr, pending.readings.count()));
+        return;
+    }
+    if (pending.plant)
+        m_profiles.setAlias(pending.address, name);
+    for (Reading reading : pending.readings) {
+        reading.tagValue = name;
+        if (pending.plant)
+            storePlantReading(reading, pending.deviceName);
+        else
+            storeBodyComp(reading);
     }
 }
@@ -20,17 +20,25 @@
 
 #include <QBluetoothDeviceDiscoveryAgent>
 #include <QBluetoothDeviceInfo>
-#include <QLowEnergyController>
-#include <QLowEnergyService>
-#include <QNetworkAccessManager>
-#include <QNetworkRequest>
-#include <QNetworkReply>
+#include <QQueue>
+#include <QScopedPointer>
+#include <QSet>
 #include <QSettings>
-
-struct DeviceInfo {
-    QBluetoothDeviceInfo info;
-    QLowEnergyController *controller;
-};
+#include "advertcache.h"
+#include "framedecoder.h"
+#include "gattcache.h"
+#include "latencytracker.h"
+#include "profilestore.h"
+#include "reading.h"
+#include "userindex.h"
+
+struct DeviceDriver;
+class DecodeStage;
+class DeviceSession;
+class ReadingSink;
+class ScanScheduler;
+class SinkPipeline;
+class TimeSeriesStore;
 
 class TrayBle : public QObject
 {
@@ -45,10 +53,22 @@ public:
     void setStatus(QString s);
 
     void deviceSearch();
+    QString scanStatistics() const;
+    QString statistics() const;
     void connectService(const QBluetoothDeviceInfo &device);
-    void disconnectService();
-    void sendRequest();
     QSettings &settings() { return m_settings; }
+    ProfileStore &profiles() { return m_profiles; }
+    TimeSeriesStore *history() const { return m_history.data(); }
+
+    void setReplaying(bool replaying) { m_replaying = replaying; }
+
+public slots:
+    void replayAdvertisement(const QBluetoothDeviceInfo &device, QBluetoothDeviceInfo::Fields updatedFields);
+    void replayConnected(const QBluetoothAddress &address);
+    void replayNotification(const QBluetoothAddress &address, quint16 handle, const QByteArray &value);
+    bool saveStatistics(const QString &fileName);
+    void identify(quint64 request, const QString &name);
+    void restorePending();
 
 private slots:
     void addDevice(const QBluetoothDeviceInfo&);
@@ -56,56 +76,67 @@ private slots:
     void scanFinished();
     void deviceScanError(QBluetoothDeviceDiscoveryAgent::Error);
 
-    void serviceDiscovered(const QBluetoothUuid &svc);
-    void serviceScanDone();
-    void controllerError(QLowEnergyController::Error e);
-    void deviceConnected();
-    void deviceDisconnected();
+    void sessionFinished(DeviceSession *session);
+    void updateBodyComp(DeviceSession *session, const FrameDecoder::Values &values, qint64 timestamp);
 
-    void serviceStateChanged(QLowEnergyService::ServiceState s);
-    void updateBodyComp(const QLowEnergyCharacteristic &c,
-                              const QByteArray &value);
-    void serviceError(QLowEnergyService::ServiceError e);
-
-    void decodeIBeaconData(const QBluetoothDeviceInfo &dev, QByteArray data);
-
-    void networkFinished();
-    void networkError(QNetworkReply::NetworkError e);
+    void decodeAdvertisement(const QBluetoothDeviceInfo &dev, const DeviceDriver *driver, const QByteArray &data,
+                             qint64 timestamp);
+    void showPlantReading(const Reading &reading, const QString &deviceName);
 
 signals:
     void error(QString message);
     void statusChanged(QString message);
     void notify(QString title, QString message);
     void readingUpdated(QString context, QString values);
+    void identificationRequested(quint64 request, const QString &question, const QString &suggestion);
 
 private:
-    QByteArray userCharacteristic(QString user);
+    void startSession(const QBluetoothDeviceInfo &device);
+    void addSink(ReadingSink *sink);
+    QByteArray userCharacteristic(const QString &user) const;
+
+    // readings that can't be stored until someone says whose (or which plant's) they are
+    struct PendingIdentification {
+        bool plant = false;     // or else a scale user
+        QBluetoothAddress address;
+        QString deviceName;
+        QString suggestion;
+        QString question;
+        QVector<Reading> readings;
+    };
+    void requestIdentification(const PendingIdentification &pending, const QString &question);
+    void savePending() const;
+    void storePlantReading(const Reading &reading, const QString &deviceName);
+    void storeBodyComp(const Reading &reading);
 
 private:
     QBluetoothDeviceDiscoveryAgent *m_discoveryAgent = nullptr;
-    QSet<QString> m_discoveredDevices;
-    QHash<QString, DeviceInfo> m_connectedDevices; // by QBluetoothAddress.toString(), because QBluetoothAddress qHash impl is missing
-    QLowEnergyDescriptor m_notification;
-    QBluetoothUuid m_serviceUuid;
-    QLowEnergyService *m_service = nullptr; // TODO nix
+    ScanScheduler *m_scanScheduler = nullptr;
+    QHash<QString, const DeviceDriver *> m_discoveredDevices; // by address
+    AdvertCache m_advertCache;
+    QHash<QString, DeviceSession *> m_sessions; // by QBluetoothAddress.toString(), because QBluetoothAddress qHash impl is missing
+    QQueue<QBluetoothDeviceInfo> m_pendingConnections;
+    int m_maxSessions = 4;
+    int m_sessionTimeout = 60000; // ms without a reading before a session gives up
+    bool m_replaying = false;
+    QSet<quint64> m_replayedReadings;   // connections in the capture that have had their reading
     QString m_status;
     QString m_lastUser;
+    QHash<quint64, PendingIdentification> m_pendingIdentifications;
+    quint64 m_nextIdentification = 1;
+    QString m_pendingFileName;  // where they're kept between runs
 
     QSettings m_settings;
-
-    QNetworkAccessManager m_nam;
-    QNetworkRequest m_influxHealthInsertReq;
-    QNetworkRequest m_influxPlantsInsertReq;
-    QNetworkReply *m_netReply = nullptr;
-
-    qreal m_weight = 0;
-    qreal m_fat = 0;
-    qreal m_bone = 0;
-    qreal m_muscle = 0;
-    qreal m_vfat = 0;
-    qreal m_water = 0;
-    int m_bmr = 0;
-    bool m_updatedBodyComp = false;
+    GattCache m_gattCache;
+    ProfileStore m_profiles;
+    LatencyTracker m_latency;
+    UserIndex m_userIndex;
+    qreal m_minIdentifyConfidence = 0.6;
+
+    DecodeStage *m_decode = nullptr;      // on its own thread, along with the rollup
+    SinkPipeline *m_pipeline = nullptr;
+    SinkPipeline *m_live = nullptr;       // sinks that want every reading as it's decoded
+    QScopedPointer<TimeSeriesStore> m_history;
 };
 
 #endif // TRAYBLE_H
@@ -1,15 +1,25 @@
 TEMPLATE = app
 TARGET = trayble
 
-QT += widgets bluetooth svg network
+QT += widgets svg
 CONFIG += debug
 
-HEADERS += trayble.h \
+include(core.pri)
+
+HEADERS += \
+    devicemodel.h \
+    devicewindow.h \
+    historywindow.h \
+    statuspresenter.h \
     trayicon.h \
     userdialog.h
 
-SOURCES += trayble.cpp \
+SOURCES += \
+    devicemodel.cpp \
+    devicewindow.cpp \
+    historywindow.cpp \
     main.cpp \
+    statuspresenter.cpp \
     trayicon.cpp \
     userdialog.cpp
 
@@ -1,29 +1,54 @@
 #include "trayicon.h"
+#include "devicewindow.h"
+#include "historywindow.h"
 #include "userdialog.h"
 #include <QApplication>
 #include <QBluetoothAddress>
 #include <QDebug>
+#include <QFileDialog>
+#include <QInputDialog>
 #include <QMenu>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QSettings>
 
-TrayIcon::TrayIcon(QSettings &settings) :
-    m_settings(settings),
+TrayIcon::TrayIcon(ProfileStore &profiles, const TimeSeriesStore *history) :
+    m_profiles(profiles),
+    m_history(history),
     m_normalIcon(":/icons/bathroom-scale-dial.svg")
 {
     setIcon(m_normalIcon);
     m_separator = m_menu.addSeparator();
+    QObject::connect(m_menu.addAction(tr("Devices...")), &QAction::triggered,
+                     this, &TrayIcon::showDevices);
+    QObject::connect(m_menu.addAction(tr("Statistics...")), &QAction::triggered,
+                     this, &TrayIcon::statisticsRequested);
     QObject::connect(m_menu.addAction(tr("Quit")), &QAction::triggered,
                      qApp, &QApplication::quit);
     setContextMenu(&m_menu);
-    // populate the menu with last-known weights
-    m_settings.beginGroup(QLatin1String("UserWeights"));
-    for (const QString &user : m_settings.childKeys()) {
-        QMenu *sub = new QMenu(user);
-        m_deviceMenus.insert(user, sub);
-        m_menu.insertMenu(m_separator, sub);
-        sub->addAction(m_settings.value(user).toString());
-        sub->addAction(tr("Settings"), this, &TrayIcon::openSettings)->setData(user);
+
+    QSettings settings;
+    m_maxRecent = settings.value(QLatin1String("General/menuDevices"), m_maxRecent).toInt();
+    // start with last-known weights, not shown as updated since starting
+    for (const QString &user : m_profiles.userNames()) {
+        const qreal weight = m_profiles.user(user).lastWeight;
+        if (weight > 0)
+            m_devices.update(user, QString::number(weight), true, 0);
+    }
+    for (const QString &context : settings.value(QLatin1String("General/pinned")).toStringList()) {
+        if (!m_devices.contains(context))
+            m_devices.update(context, QString(), false, 0);
+        m_devices.setPinned(context, true);
+        showInMenu(context);
     }
-    m_settings.endGroup();
+    for (const QString &user : m_devices.mostRecent(m_maxRecent))
+        showInMenu(user);
+    connect(&m_devices, &DeviceModel::pinnedChanged, this, &TrayIcon::pinnedChanged);
+}
+
+TrayIcon::~TrayIcon()
+{
+    delete m_deviceWindow; // it uses m_devices
 }
 
 void TrayIcon::showTooltip(const QString &message)
@@ -38,29 +63,113 @@ void TrayIcon::showError(const QString &message)
 
 void TrayIcon::showReading(QString context, QString values)
 {
+    m_devices.update(context, values, m_profiles.isUser(context));
+    showInMenu(context);
+}
+
+/*!
+    Adds or updates the submenu for \a context, and forgets the least
+    recently updated unpinned one if there are too many.
+*/
+void TrayIcon::showInMenu(const QString &context)
+{
+    const bool pinned = m_devices.isPinned(context);
+    if (!pinned) {
+        m_recent.removeOne(context);
+        m_recent.prepend(context);
+    }
     auto it = m_deviceMenus.find(context);
     if (it == m_deviceMenus.end()) {
-        QMenu *sub = new QMenu(context);
-        m_deviceMenus.insert(context, sub);
-        m_menu.insertMenu(m_separator, sub);
-        sub->addAction(values);
-        m_settings.beginGroup(QLatin1String("UserWeights"));
-        if (m_settings.value(context).isValid()) { // it's a user, not a plant
-            sub->addAction(tr("Settings"), this, &TrayIcon::openSettings)->setData(context);
-        }
-        m_settings.endGroup();
-    } else {
-        QMenu *sub = *it;
-        Q_ASSERT(sub);
-        Q_ASSERT(sub->children().count() > 1);
-        QAction *subAction = static_cast<QAction*>(sub->children().at(1));
-        subAction->setText(values);
+        DeviceMenu d;
+        d.menu = new QMenu(context);
+        d.values = d.menu->addAction(QString());
+        if (m_history)
+            d.menu->addAction(tr("History"), this, [this, context]() { showHistory(context); });
+        if (m_devices.isUser(context)) // it's a user, not a plant
+            d.menu->addAction(tr("Settings"), this, [this, context]() { openSettings(context); });
+        m_menu.insertMenu(m_separator, d.menu);
+        it = m_deviceMenus.insert(context, d);
     }
+    it->values->setText(m_devices.values(context));
+    while (m_recent.count() > m_maxRecent)
+        removeFromMenu(m_recent.takeLast());
+}
+
+void TrayIcon::removeFromMenu(const QString &context)
+{
+    const DeviceMenu d = m_deviceMenus.take(context);
+    delete d.menu;
+}
+
+void TrayIcon::pinnedChanged(const QString &context, bool pinned)
+{
+    if (pinned)
+        m_recent.removeOne(context);
+    showInMenu(context); // if unpinned, it stays for now, as the most recent one
+    QSettings().setValue(QLatin1String("General/pinned"), m_devices.pinned());
 }
 
-void TrayIcon::openSettings()
+void TrayIcon::openSettings(const QString &user)
 {
-    UserDialog *dlg = new UserDialog(nullptr, m_settings, static_cast<QAction *>(sender())->data().toString());
+    UserDialog *dlg = new UserDialog(nullptr, m_profiles, user);
     // it has to delete itself when closed
     dlg->show();
 }
+
+void TrayIcon::showDevices()
+{
+    if (!m_deviceWindow) {
+        m_deviceWindow = new DeviceWindow(&m_devices);
+        m_deviceWindow->setAttribute(Qt::WA_DeleteOnClose);
+        connect(m_deviceWindow.data(), &DeviceWindow::settingsRequested, this, &TrayIcon::openSettings);
+        connect(m_deviceWindow.data(), &DeviceWindow::historyRequested, this, &TrayIcon::showHistory);
+    }
+    m_deviceWindow->show();
+    m_deviceWindow->raise();
+    m_deviceWindow->activateWindow();
+}
+
+void TrayIcon::showHistory(const QString &context)
+{
+    if (!m_history) {
+        showError(tr("History is not being kept; add history to the sinks setting."));
+        return;
+    }
+    HistoryWindow *w = new HistoryWindow(m_history, m_devices.isUser(context) ? QLatin1String("bodycomp")
+                                                                               : QLatin1String("plants"), context);
+    w->setAttribute(Qt::WA_DeleteOnClose);
+    w->show();
+}
+
+void TrayIcon::showStatistics(const QString &text)
+{
+    QMessageBox *box = new QMessageBox(QMessageBox::Information, QApplication::applicationName(),
+                                       QStringLiteral("<pre>%1</pre>").arg(text.toHtmlEscaped()),
+                                       QMessageBox::Close);
+    box->setAttribute(Qt::WA_DeleteOnClose);
+    QPushButton *save = box->addButton(tr("Save..."), QMessageBox::ActionRole);
+    connect(save, &QPushButton::clicked, this, [this]() {
+        QString fileName = QFileDialog::getSaveFileName(nullptr, tr("Save statistics"),
+                                                        QLatin1String("trayble-latency.txt"));
+        if (!fileName.isEmpty())
+            emit statisticsSaveRequested(fileName);
+    });
+    box->show();
+}
+
+void TrayIcon::askIdentity(quint64 request, const QString &question, const QString &suggestion)
+{
+    // don't block: more readings (and more questions) may arrive meanwhile
+    QInputDialog *dlg = new QInputDialog;
+    dlg->setAttribute(Qt::WA_DeleteOnClose);
+    dlg->setWindowTitle(tr("Who's there?"));
+    dlg->setLabelText(question);
+    dlg->setTextValue(suggestion);
+    connect(dlg, &QInputDialog::textValueSelected, this, [this, request](const QString &name) {
+        emit identified(request, name.trimmed());
+    });
+    connect(dlg, &QDialog::rejected, this, [this, request]() {
+        emit identified(request, QString());
+    });
+    dlg->show();
+}
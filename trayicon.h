@@ -3,29 +3,62 @@
 
 #include <QBluetoothDeviceInfo>
 #include <QMenu>
-#include <QSettings>
+#include <QPointer>
 #include <QSystemTrayIcon>
+#include "devicemodel.h"
+#include "profilestore.h"
 
+class TimeSeriesStore;
+
+class DeviceWindow;
 class QAction;
 
 class TrayIcon : public QSystemTrayIcon
 {
     Q_OBJECT
 public:
-    TrayIcon(QSettings &settings);
+    // without a history, the device menus have no History action
+    TrayIcon(ProfileStore &profiles, const TimeSeriesStore *history = nullptr);
+    ~TrayIcon();
 
 public slots:
     void showTooltip(const QString &message);
     void showError(const QString &message);
     void showReading(QString context, QString values);
-    void openSettings();
+    void openSettings(const QString &user);
+    void showDevices();
+    void showHistory(const QString &context);
+    void showStatistics(const QString &text);
+    void askIdentity(quint64 request, const QString &question, const QString &suggestion);
+
+signals:
+    void statisticsRequested();
+    void statisticsSaveRequested(const QString &fileName);
+    void identified(quint64 request, const QString &name);
 
 private:
-    QSettings &m_settings;
+    void showInMenu(const QString &context);
+    void removeFromMenu(const QString &context);
+    void pinnedChanged(const QString &context, bool pinned);
+
+private:
+    // the tray menu shows the pinned devices and the few most recent others;
+    // DeviceWindow shows them all
+    struct DeviceMenu {
+        QMenu *menu = nullptr;
+        QAction *values = nullptr;
+    };
+
+    ProfileStore &m_profiles;
+    const TimeSeriesStore *m_history = nullptr;
     QIcon m_normalIcon;
     QMenu m_menu;
     QAction *m_separator;
-    QHash<QString, QMenu*> m_deviceMenus;
+    QHash<QString, DeviceMenu> m_deviceMenus;
+    QStringList m_recent;   // in the menu and not pinned, most recent first
+    int m_maxRecent = 8;
+    DeviceModel m_devices;
+    QPointer<DeviceWindow> m_deviceWindow;
 };
 
 #endif // TRAYICON_H
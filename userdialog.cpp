@@ -1,28 +1,24 @@
 #include "userdialog.h"
 #include "ui_userdialog.h"
 
-UserDialog::UserDialog(QWidget *parent, QSettings &settings, QString name) :
+UserDialog::UserDialog(QWidget *parent, ProfileStore &profiles, QString name) :
     QDialog(parent),
     ui(new Ui::UserDialog),
-    m_settings(settings),
+    m_profiles(profiles),
     m_name(name)
 {
     ui->setupUi(this);
     ui->name->setText(name);
 
-    m_settings.beginGroup(QLatin1String("UserID"));
-    ui->userID->setValue(m_settings.value(name, 99).toInt());
-    m_settings.endGroup();
+    const UserProfile &profile = m_profiles.user(name);
+    ui->userID->setValue(profile.id);
 
-    m_settings.beginGroup(QLatin1String("UserGender"));
-    if (m_settings.value(name, "m") == "m")
+    if (profile.male)
         ui->genderMale->setChecked(true);
     else
         ui->genderFemale->setChecked(true);
-    m_settings.endGroup();
 
-    m_settings.beginGroup(QLatin1String("UserExerciseLevel"));
-    switch (m_settings.value(name, 0).toInt()) {
+    switch (profile.exerciseLevel) {
     case 0:
         ui->athleticNot->setChecked(true);
         break;
@@ -33,32 +29,21 @@ UserDialog::UserDialog(QWidget *parent, QSettings &settings, QString name) :
         ui->athleticProfessional->setChecked(true);
         break;
     }
-    m_settings.endGroup();
 
-    m_settings.beginGroup(QLatin1String("UserHeight"));
-    ui->height->setValue(m_settings.value(name, 170).toInt());
-    m_settings.endGroup();
+    ui->height->setValue(profile.height);
+    ui->birthday->setDate(profile.birthday);
 
-    m_settings.beginGroup(QLatin1String("UserBirthday"));
-    ui->birthday->setDate(m_settings.value(name, QDate(1990, 1, 1)).toDate());
-    m_settings.endGroup();
-
-    m_settings.beginGroup(QLatin1String("UserUnits"));
-    QString unitsString = m_settings.value(name, 0).toString();
-    if (!unitsString.isEmpty()) {
-        switch (unitsString.at(0).toLatin1()) {
-        case 's':
-            ui->unitsStones->setChecked(true);
-            break;
-        case 'k':
-            ui->unitsKG->setChecked(true);
-            break;
-        case 'p':
-            ui->unitsPounds->setChecked(true);
-            break;
-        }
+    switch (profile.units) {
+    case UserProfile::Stones:
+        ui->unitsStones->setChecked(true);
+        break;
+    case UserProfile::Kilograms:
+        ui->unitsKG->setChecked(true);
+        break;
+    case UserProfile::Pounds:
+        ui->unitsPounds->setChecked(true);
+        break;
     }
-    m_settings.endGroup();
 }
 
 UserDialog::~UserDialog()
@@ -68,42 +53,32 @@ UserDialog::~UserDialog()
 
 void UserDialog::on_buttonBox_accepted()
 {
-    m_settings.beginGroup(QLatin1String("UserID"));
-    m_settings.setValue(m_name, ui->userID->value());
-    m_settings.endGroup();
+    UserProfile profile = m_profiles.user(m_name);
+    profile.id = quint8(ui->userID->value());
 
-    m_settings.beginGroup(QLatin1String("UserGender"));
     if (ui->genderMale->isChecked())
-        m_settings.setValue(m_name, "m");
+        profile.male = true;
     if (ui->genderFemale->isChecked())
-        m_settings.setValue(m_name, "f");
-    m_settings.endGroup();
+        profile.male = false;
 
-    m_settings.beginGroup(QLatin1String("UserExerciseLevel"));
     if (ui->athleticNot->isChecked())
-        m_settings.setValue(m_name, 0);
+        profile.exerciseLevel = 0;
     if (ui->athleticAmateur->isChecked())
-        m_settings.setValue(m_name, 1);
+        profile.exerciseLevel = 1;
     if (ui->athleticProfessional->isChecked())
-        m_settings.setValue(m_name, 2);
-    m_settings.endGroup();
-
-    m_settings.beginGroup(QLatin1String("UserHeight"));
-    m_settings.setValue(m_name, ui->height->value());
-    m_settings.endGroup();
+        profile.exerciseLevel = 2;
 
-    m_settings.beginGroup(QLatin1String("UserBirthday"));
-    m_settings.setValue(m_name, ui->birthday->date());
-    m_settings.endGroup();
+    profile.height = quint8(ui->height->value());
+    profile.birthday = ui->birthday->date();
 
-    m_settings.beginGroup(QLatin1String("UserUnits"));
     if (ui->unitsStones->isChecked())
-        m_settings.setValue(m_name, "stones");
+        profile.units = UserProfile::Stones;
     if (ui->unitsKG->isChecked())
-        m_settings.setValue(m_name, "kilograms");
+        profile.units = UserProfile::Kilograms;
     if (ui->unitsPounds->isChecked())
-        m_settings.setValue(m_name, "pounds");
-    m_settings.endGroup();
+        profile.units = UserProfile::Pounds;
+
+    m_profiles.setUser(m_name, profile);
 
     delete this;
 }
@@ -2,7 +2,7 @@
 #define USERDIALOG_H
 
 #include <QDialog>
-#include <QSettings>
+#include "profilestore.h"
 
 namespace Ui {
 class UserDialog;
@@ -13,7 +13,7 @@ class UserDialog : public QDialog
     Q_OBJECT
 
 public:
-    explicit UserDialog(QWidget *parent, QSettings &settings, QString name);
+    explicit UserDialog(QWidget *parent, ProfileStore &profiles, QString name);
     ~UserDialog();
 
 private slots:
@@ -23,7 +23,7 @@ private slots:
 
 private:
     Ui::UserDialog *ui;
-    QSettings &m_settings;
+    ProfileStore &m_profiles;
     QString m_name;
 };
 
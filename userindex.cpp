@@ -0,0 +1,164 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#include "userindex.h"
+#include "historysink.h"
+#include "timeseriesstore.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <limits>
+#include <cmath>
+
+const FrameDecoder::Quantity UserIndex::features[FeatureCount] = {
+    FrameDecoder::Weight, FrameDecoder::Fat, FrameDecoder::Water,
+    FrameDecoder::Muscle, FrameDecoder::Bone, FrameDecoder::Bmr
+};
+
+// kg, %, %, kg, kg, kcal: about what one person varies from day to day
+const qreal UserIndex::minDeviation[FeatureCount] = { 1.7, 1.5, 1.5, 1.0, 0.2, 30 };
+
+UserIndex::UserIndex(int historyLength)
+    : m_historyLength(qMax(1, historyLength))
+{
+}
+
+void UserIndex::accumulate(Model &m, const FrameDecoder::Values &values, int sign)
+{
+    for (int f = 0; f < FeatureCount; ++f) {
+        if (!values.has(features[f]))
+            continue;
+        const qreal v = values[features[f]];
+        m.count[f] += sign;
+        m.sum[f] += sign * v;
+        m.sumSquares[f] += sign * v * v;
+    }
+}
+
+void UserIndex::add(const QString &user, const FrameDecoder::Values &values)
+{
+    Model &m = m_users[user];
+    if (m.samples.count() < m_historyLength) {
+        m.samples.append(values);
+    } else {
+        accumulate(m, m.samples.at(m.next), -1);
+        m.samples[m.next] = values;
+        m.next = (m.next + 1) % m_historyLength;
+    }
+    accumulate(m, values, 1);
+}
+
+int UserIndex::sampleCount(const QString &user) const
+{
+    return m_users.value(user).samples.count();
+}
+
+qreal UserIndex::distanceSquared(const Model &m, const FrameDecoder::Values &values, int *featureCount)
+{
+    qreal ret = 0;
+    int n = 0;
+    for (int f = 0; f < FeatureCount; ++f) {
+        if (!m.count[f] || !values.has(features[f]))
+            continue;
+        const qreal mean = m.sum[f] / m.count[f];
+        qreal variance = m.count[f] > 1
+                ? (m.sumSquares[f] - m.sum[f] * mean) / (m.count[f] - 1) : 0;
+        variance = qMax(variance, minDeviation[f] * minDeviation[f]);
+        const qreal d = values[features[f]] - mean;
+        ret += d * d / variance;
+        ++n;
+    }
+    *featureCount = n;
+    return ret;
+}
+
+UserIndex::Match UserIndex::identify(const FrameDecoder::Values &values) const
+{
+    Match ret;
+    qreal best = std::numeric_limits<qreal>::max();
+    qreal bestLikelihood = 0;
+    qreal totalLikelihood = 0;
+    for (auto it = m_users.constBegin(); it != m_users.constEnd(); ++it) {
+        int n = 0;
+        const qreal d2 = distanceSquared(it.value(), values, &n);
+        if (!n)
+            continue;
+        const qreal meanSquare = d2 / n;
+        // compare users by mean square distance, so that those known only
+        // by weight compete fairly with those with a full history
+        const qreal likelihood = std::exp(-0.5 * meanSquare);
+        totalLikelihood += likelihood;
+        if (meanSquare < best) {
+            best = meanSquare;
+            bestLikelihood = likelihood;
+            ret.user = it.key();
+        }
+    }
+    if (ret.user.isEmpty())
+        return ret;
+    ret.distance = std::sqrt(best);
+    ret.confidence = totalLikelihood > 0 ? bestLikelihood / totalLikelihood : 1;
+    ret.known = ret.distance <= m_maxDistance;
+    return ret;
+}
+
+/*!
+    Fills the index with each user's most recent body composition readings
+    from the local history.
+*/
+void UserIndex::load(const TimeSeriesStore &history)
+{
+    QElapsedTimer t;
+    t.start();
+    const QString prefix = QLatin1String("bodycomp/");
+    const QString weightSuffix = QLatin1Char('/') + QLatin1String(FrameDecoder::quantityName(FrameDecoder::Weight));
+    int readings = 0;
+    for (const QString &series : history.seriesNames()) {
+        if (!series.startsWith(prefix) || !series.endsWith(weightSuffix))
+            continue;
+        const QString user = series.mid(prefix.size(), series.size() - prefix.size() - weightSuffix.size());
+        QVector<TimeSeriesStore::Point> weights = history.query(series, 0, std::numeric_limits<qint64>::max());
+        if (weights.isEmpty())
+            continue;
+        weights.remove(0, qMax(0, weights.count() - m_historyLength));
+        const qint64 from = weights.first().time;
+        const qint64 to = weights.last().time;
+
+        // all the quantities of one reading have the same timestamp
+        QVector<FrameDecoder::Values> samples(weights.count());
+        QHash<qint64, int> byTime;
+        for (int i = 0; i < weights.count(); ++i) {
+            byTime.insert(weights.at(i).time, i);
+            samples[i].value[FrameDecoder::Weight] = weights.at(i).value;
+            samples[i].present |= 1u << FrameDecoder::Weight;
+        }
+        for (int f = 1; f < FeatureCount; ++f) {
+            const auto points = history.query(HistorySink::seriesName(QLatin1String("bodycomp"), user, features[f]), from, to);
+            for (const TimeSeriesStore::Point &p : points) {
+                const int i = byTime.value(p.time, -1);
+                if (i < 0)
+                    continue;
+                samples[i].value[features[f]] = p.value;
+                samples[i].present |= 1u << features[f];
+            }
+        }
+        m_users.remove(user);
+        for (const FrameDecoder::Values &v : samples)
+            add(user, v);
+        readings += samples.count();
+    }
+    qDebug() << "loaded" << readings << "readings of" << m_users.count() << "users in" << t.elapsed() << "ms";
+}
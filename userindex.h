@@ -0,0 +1,84 @@
+/****************************************************************************
+**
+** Copyright (C) 2018 Shawn Rutledge
+**
+** This file is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation
+** and appearing in the file LICENSE included in the packaging
+** of this file.
+**
+** This code is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+****************************************************************************/
+
+#ifndef USERINDEX_H
+#define USERINDEX_H
+
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+#include "framedecoder.h"
+
+class TimeSeriesStore;
+
+/*
+    Recognizes who is standing on the scale from the whole body
+    composition, not just the weight.  For each user it keeps the last few
+    readings and running sums, so the mean and spread of each quantity are
+    always at hand; a new reading is compared with every user by the RMS
+    of its distances from their means, in standard deviations.  The
+    spreads have floors, so a user with only a reading or two isn't
+    expected to be impossibly consistent.
+
+    The confidence is the nearest user's share of the likelihood among all
+    users; it's low when two people of similar build both fit.
+*/
+class UserIndex
+{
+public:
+    struct Match {
+        QString user;           // nearest, or empty if there are no users yet
+        qreal distance = -1;    // RMS distance in standard deviations
+        qreal confidence = 0;   // 0 to 1
+        bool known = false;     // close enough to be that user at all
+    };
+
+    explicit UserIndex(int historyLength = 30);
+
+    void setMaxDistance(qreal deviations) { m_maxDistance = deviations; }
+
+    void add(const QString &user, const FrameDecoder::Values &values);
+    void remove(const QString &user) { m_users.remove(user); }
+    Match identify(const FrameDecoder::Values &values) const;
+    QStringList users() const { return m_users.keys(); }
+    int sampleCount(const QString &user) const;
+
+    void load(const TimeSeriesStore &history);
+
+private:
+    enum { FeatureCount = 6 };
+    static const FrameDecoder::Quantity features[FeatureCount];
+    static const qreal minDeviation[FeatureCount];
+
+    struct Model {
+        QVector<FrameDecoder::Values> samples;  // ring buffer
+        int next = 0;
+        int count[FeatureCount] = {};
+        qreal sum[FeatureCount] = {};
+        qreal sumSquares[FeatureCount] = {};
+    };
+
+    static void accumulate(Model &m, const FrameDecoder::Values &values, int sign);
+    static qreal distanceSquared(const Model &m, const FrameDecoder::Values &values, int *featureCount);
+
+private:
+    QHash<QString, Model> m_users;
+    int m_historyLength;
+    qreal m_maxDistance = 3;
+};
+
+#endif // USERINDEX_H